@@ -0,0 +1,217 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include "config.h"
+#include "BatchEvaluator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "GameState.h"
+#include "Network.h"
+#include "SGFParser.h"
+#include "SGFTree.h"
+#include "Timing.h"
+#include "Utils.h"
+
+using namespace Utils;
+
+namespace {
+
+void append_le(std::string& buffer, std::uint32_t value, size_t bytes) {
+    for (auto i = size_t{0}; i < bytes; i++) {
+        buffer.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+void append_float_le(std::string& buffer, float value) {
+    auto bits = std::uint32_t{};
+    std::memcpy(&bits, &value, sizeof(bits));
+    append_le(buffer, bits, sizeof(bits));
+}
+
+// Evaluates the positions of one game into buffer, all of them or
+// those in moves, returns how many.
+size_t evaluate_game(Network& network, const std::string& sgf,
+                     std::uint32_t game_index, const std::vector<int>* moves,
+                     std::string& buffer) {
+    auto sgftree = std::make_unique<SGFTree>();
+    try {
+        sgftree->load_mainline_from_string(sgf);
+    } catch (...) {
+        return 0;
+    }
+
+    auto state =
+        std::make_unique<GameState>(sgftree->follow_mainline_state());
+    // Our board size is hardcoded in several places
+    if (state->board.get_boardsize() != BOARD_SIZE) {
+        return 0;
+    }
+
+    auto positions = size_t{0};
+    state->rewind();
+    do {
+        const auto movenum = int(state->get_movenum());
+        if (moves && !std::binary_search(begin(*moves), end(*moves),
+                                         movenum)) {
+            continue;
+        }
+        // Raw outputs only: one orientation, and nothing to reuse
+        // from or leave in the cache.
+        const auto result = network.get_output(
+            state.get(), Network::DIRECT, Network::IDENTITY_SYMMETRY,
+            false, false);
+
+        append_le(buffer, game_index, 4);
+        append_le(buffer, movenum, 2);
+        append_le(buffer, state->get_to_move(), 1);
+        append_le(buffer, 0, 1);
+        append_float_le(buffer, result.winrate);
+        for (const auto policy : result.policy) {
+            append_float_le(buffer, policy);
+        }
+        append_float_le(buffer, result.policy_pass);
+        positions++;
+    } while (state->forward_move());
+
+    return positions;
+}
+
+}
+
+BatchEvaluator::Selection BatchEvaluator::read_selection(
+    const std::string& filename) {
+    auto in = std::ifstream{filename};
+    if (!in) {
+        throw std::runtime_error("Error opening file");
+    }
+    auto selection = Selection{};
+    auto line = std::string{};
+    while (std::getline(in, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        auto linestream = std::istringstream{line};
+        auto game = std::uint32_t{0};
+        auto separator = char{0};
+        auto move = -1;
+        linestream >> game >> separator >> move;
+        if (linestream.fail() || separator != ':' || move < 0) {
+            throw std::runtime_error("Cannot parse position " + line);
+        }
+        selection[game].emplace_back(move);
+    }
+    for (auto& game : selection) {
+        auto& moves = game.second;
+        std::sort(begin(moves), end(moves));
+        moves.erase(std::unique(begin(moves), end(moves)), end(moves));
+    }
+    return selection;
+}
+
+size_t BatchEvaluator::run(Network& network, const std::string& sgf_name,
+                           const std::string& out_name, size_t num_threads,
+                           const Selection& selection) {
+    auto ins = std::ifstream{sgf_name, std::ifstream::binary | std::ifstream::in};
+    if (ins.fail()) {
+        throw std::runtime_error("Error opening file");
+    }
+    auto out = std::ofstream{out_name, std::ofstream::binary | std::ofstream::out};
+    if (out.fail()) {
+        throw std::runtime_error("Error opening file");
+    }
+    out.write(MAGIC, std::strlen(MAGIC));
+
+    // Workers take games straight from the file and write whole games,
+    // so neither side needs a queue.
+    std::mutex in_mutex, out_mutex;
+    auto games = std::uint32_t{0};
+    std::atomic<size_t> positions{0};
+
+    Time start;
+    auto workers = std::vector<std::thread>{};
+    num_threads = std::max(num_threads, size_t{1});
+    for (auto i = size_t{0}; i < num_threads; i++) {
+        workers.emplace_back([&] {
+            auto game = std::string{};
+            auto buffer = std::string{};
+            for (;;) {
+                auto game_index = std::uint32_t{0};
+                {
+                    std::lock_guard<std::mutex> lock(in_mutex);
+                    if (!SGFParser::chop_next(ins, game)) {
+                        return;
+                    }
+                    game_index = games++;
+                }
+                auto moves = static_cast<const std::vector<int>*>(nullptr);
+                if (!selection.empty()) {
+                    const auto picked = selection.find(game_index);
+                    if (picked == end(selection)) {
+                        continue;
+                    }
+                    moves = &picked->second;
+                }
+                buffer.clear();
+                const auto evaluated =
+                    evaluate_game(network, game, game_index, moves, buffer);
+                {
+                    std::lock_guard<std::mutex> lock(out_mutex);
+                    out.write(buffer.data(), buffer.size());
+                }
+                const auto total = positions += evaluated;
+                if (total / 10000 != (total - evaluated) / 10000) {
+                    Time elapsed;
+                    const auto elapsed_s = Time::timediff_seconds(start, elapsed);
+                    myprintf("%7d positions in %5.2f seconds -> %d pos/s\n",
+                             int(total), elapsed_s, int(total / elapsed_s));
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    Time elapsed;
+    const auto elapsed_s = Time::timediff_seconds(start, elapsed);
+    myprintf("Evaluated %d positions of %d games in %5.2f seconds -> %d pos/s\n",
+             int(positions), int(games), elapsed_s,
+             int(positions / std::max(elapsed_s, 0.01)));
+    return positions;
+}
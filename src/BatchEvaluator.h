@@ -0,0 +1,81 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#ifndef BATCHEVALUATOR_H_INCLUDED
+#define BATCHEVALUATOR_H_INCLUDED
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Network;
+
+/*
+    Raw network outputs for mainline positions of an SGF database,
+    without search: all of them, or those picked in a positions file.
+    Positions are evaluated from several threads at once, so that the
+    OpenCL scheduler can fill its batches.
+
+    A positions file has one "game:move" line per position, the index
+    of the game in the SGF file from 0 and the move number, 0 for the
+    start of the game.
+
+    The output file starts with the 8 byte magic "LZEVAL02", followed
+    by one record per position, little endian:
+
+        uint32  game index in the SGF file, from 0
+        uint16  move number
+        uint8   side to move, 0 black, 1 white
+        uint8   0
+        float   winrate for the side to move
+        float   policy[NUM_INTERSECTIONS + 1], a1, b1, ..., then pass
+
+    Records of different games can be interleaved.
+*/
+class BatchEvaluator {
+public:
+    static constexpr auto MAGIC = "LZEVAL02";
+
+    // Move numbers to evaluate by game index, empty for all of them.
+    using Selection = std::unordered_map<std::uint32_t, std::vector<int>>;
+
+    // Throws std::runtime_error if the file cannot be read or parsed.
+    static Selection read_selection(const std::string& filename);
+
+    // Returns the number of positions evaluated.
+    static size_t run(Network& network, const std::string& sgf_name,
+                      const std::string& out_name, size_t num_threads,
+                      const Selection& selection = Selection{});
+};
+
+#endif
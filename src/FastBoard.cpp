@@ -201,6 +201,12 @@ int FastBoard::count_pliberties(const int i) const {
     return count_neighbours(EMPTY, i);
 }
 
+// liberties of the string at vertex
+int FastBoard::get_liberties(const int vertex) const {
+    assert(m_state[vertex] == WHITE || m_state[vertex] == BLACK);
+    return m_libs[m_parent[vertex]];
+}
+
 // count neighbours of color c at vertex v
 // the border of the board has fake neighours of both colors
 int FastBoard::count_neighbours(const int c, const int v) const {
@@ -83,6 +83,7 @@ public:
 
     bool is_suicide(int i, int color) const;
     int count_pliberties(const int i) const;
+    int get_liberties(const int vertex) const;
     bool is_eye(const int color, const int vtx) const;
 
     float area_score(float komi) const;
@@ -31,6 +31,7 @@
 #include "FastState.h"
 
 #include <algorithm>
+#include <cassert>
 #include <iterator>
 #include <vector>
 
@@ -86,13 +87,44 @@ void FastState::play_move(int vertex) {
     play_move(board.m_tomove, vertex);
 }
 
+void FastState::play_move(int vertex, MoveUndo& undo) {
+    undo.hash = board.m_hash;
+    undo.komove = m_komove;
+    undo.lastmove = m_lastmove;
+    undo.passes = m_passes;
+    undo.tomove = board.m_tomove;
+    undo.movenum = m_movenum;
+
+    play_move(board.m_tomove, vertex, &undo.board);
+}
+
+void FastState::unplay_move(const MoveUndo& undo) {
+    assert(m_movenum == undo.movenum + 1);
+
+    if (m_lastmove != FastBoard::PASS) {
+        board.unplay_move(undo.board);
+    }
+
+    board.m_hash = undo.hash;
+    board.m_tomove = undo.tomove;
+    m_komove = undo.komove;
+    m_lastmove = undo.lastmove;
+    m_passes = undo.passes;
+    m_movenum = undo.movenum;
+}
+
 void FastState::play_move(int color, int vertex) {
+    play_move(color, vertex, nullptr);
+}
+
+void FastState::play_move(int color, int vertex,
+                          FullBoard::MoveUndo* undo) {
     board.m_hash ^= Zobrist::zobrist_ko[m_komove];
     if (vertex == FastBoard::PASS) {
         // No Ko move
         m_komove = FastBoard::NO_VERTEX;
     } else {
-        m_komove = board.update_board(color, vertex);
+        m_komove = board.update_board(color, vertex, undo);
     }
     board.m_hash ^= Zobrist::zobrist_ko[m_komove];
 
@@ -177,5 +209,5 @@ int FastState::get_handicap() const {
 }
 
 std::uint64_t FastState::get_symmetry_hash(int symmetry) const {
-    return board.calc_symmetry_hash(m_komove, symmetry);
+    return board.get_symmetry_hash(m_komove, symmetry);
 }
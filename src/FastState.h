@@ -39,11 +39,26 @@
 
 class FastState {
 public:
+    /*
+        State needed to take back a move without copying the position.
+    */
+    struct MoveUndo {
+        FullBoard::MoveUndo board;
+        std::uint64_t hash;
+        int komove;
+        int lastmove;
+        int passes;
+        int tomove;
+        size_t movenum;
+    };
+
     void init_game(int size, float komi);
     void reset_game();
     void reset_board();
 
     void play_move(int vertex);
+    void play_move(int vertex, MoveUndo& undo);
+    void unplay_move(const MoveUndo& undo);
     bool is_move_legal(int color, int vertex) const;
 
     void set_komi(float komi);
@@ -75,6 +90,7 @@ public:
 
 protected:
     void play_move(int color, int vertex);
+    void play_move(int color, int vertex, FullBoard::MoveUndo* undo);
 };
 
 #endif
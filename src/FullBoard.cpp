@@ -47,6 +47,7 @@ int FullBoard::remove_string(int i) {
     do {
         m_hash    ^= Zobrist::zobrist[m_state[pos]][pos];
         m_ko_hash ^= Zobrist::zobrist[m_state[pos]][pos];
+        update_sym_hash(Zobrist::zobrist_sym[m_state[pos]][pos]);
 
         m_state[pos] = EMPTY;
         m_parent[pos] = NUM_VERTICES;
@@ -59,6 +60,7 @@ int FullBoard::remove_string(int i) {
 
         m_hash    ^= Zobrist::zobrist[m_state[pos]][pos];
         m_ko_hash ^= Zobrist::zobrist[m_state[pos]][pos];
+        update_sym_hash(Zobrist::zobrist_sym[m_state[pos]][pos]);
 
         removed++;
         pos = m_next[pos];
@@ -118,6 +120,45 @@ std::uint64_t FullBoard::calc_symmetry_hash(int komove, int symmetry) const {
     });
 }
 
+void FullBoard::update_sym_hash(const Zobrist::SymmetryKeys& keys) {
+    for (auto s = 0; s < Zobrist::NUM_SYMMETRIES; s++) {
+        m_sym_hash[s] ^= keys[s];
+    }
+}
+
+void FullBoard::calc_sym_hash() {
+    m_sym_hash.fill(Zobrist::zobrist_empty);
+
+    for (auto i = 0; i < m_numvertices; i++) {
+        if (m_state[i] != INVAL) {
+            update_sym_hash(Zobrist::zobrist_sym[m_state[i]][i]);
+        }
+    }
+}
+
+std::uint64_t FullBoard::get_symmetry_hash(int komove, int symmetry) const {
+    assert(symmetry >= 0 && symmetry < Zobrist::NUM_SYMMETRIES);
+
+    // The precomputed tables only cover the compiled board size.
+    if (m_boardsize != BOARD_SIZE) {
+        return calc_symmetry_hash(komove, symmetry);
+    }
+
+    auto res = m_sym_hash[symmetry];
+
+    res ^= Zobrist::zobrist_pris[0][m_prisoners[0]];
+    res ^= Zobrist::zobrist_pris[1][m_prisoners[1]];
+
+    if (m_tomove == BLACK) {
+        res ^= Zobrist::zobrist_blacktomove;
+    }
+
+    res ^= Zobrist::zobrist_ko_sym[komove][symmetry];
+
+    assert(res == calc_symmetry_hash(komove, symmetry));
+    return res;
+}
+
 std::uint64_t FullBoard::get_hash() const {
     return m_hash;
 }
@@ -133,12 +174,38 @@ void FullBoard::set_to_move(int tomove) {
     FastBoard::set_to_move(tomove);
 }
 
-int FullBoard::update_board(const int color, const int i) {
+int FullBoard::update_board(const int color, const int i, MoveUndo* undo) {
     assert(i != FastBoard::PASS);
     assert(m_state[i] == EMPTY);
 
+    if (undo) {
+        undo->op_count = 0;
+        undo->suicide = false;
+        undo->vertex = i;
+        undo->color = color;
+        undo->empty_idx = m_empty_idx[i];
+        undo->prisoners = m_prisoners[color];
+        undo->next = m_next[i];
+        undo->libs = m_libs[i];
+        undo->stones = m_stones[i];
+        undo->libs_sentinel = m_libs[NUM_VERTICES];
+        undo->hash = m_hash;
+        undo->ko_hash = m_ko_hash;
+        undo->sym_hash = m_sym_hash;
+    }
+    const auto record_op = [this, undo](bool merge, int vertex, int parent) {
+        if (undo) {
+            undo->ops[undo->op_count++] = {
+                merge, static_cast<unsigned short>(vertex),
+                static_cast<unsigned short>(parent),
+                m_libs[parent], m_stones[parent]
+            };
+        }
+    };
+
     m_hash ^= Zobrist::zobrist[m_state[i]][i];
     m_ko_hash ^= Zobrist::zobrist[m_state[i]][i];
+    update_sym_hash(Zobrist::zobrist_sym[m_state[i]][i]);
 
     m_state[i] = vertex_t(color);
     m_next[i] = i;
@@ -148,6 +215,7 @@ int FullBoard::update_board(const int color, const int i) {
 
     m_hash ^= Zobrist::zobrist[m_state[i]][i];
     m_ko_hash ^= Zobrist::zobrist[m_state[i]][i];
+    update_sym_hash(Zobrist::zobrist_sym[m_state[i]][i]);
 
     /* update neighbor liberties (they all lose 1) */
     add_neighbour(i, color);
@@ -163,6 +231,7 @@ int FullBoard::update_board(const int color, const int i) {
 
         if (m_state[ai] == !color) {
             if (m_libs[m_parent[ai]] <= 0) {
+                record_op(false, ai, m_parent[ai]);
                 int this_captured = remove_string(ai);
                 captured_vtx = ai;
                 captured_stones += this_captured;
@@ -173,8 +242,10 @@ int FullBoard::update_board(const int color, const int i) {
 
             if (ip != aip) {
                 if (m_stones[ip] >= m_stones[aip]) {
+                    record_op(true, aip, ip);
                     merge_strings(ip, aip);
                 } else {
+                    record_op(true, ip, aip);
                     merge_strings(aip, ip);
                 }
             }
@@ -193,6 +264,10 @@ int FullBoard::update_board(const int color, const int i) {
     /* check whether we still live (i.e. detect suicide) */
     if (m_libs[m_parent[i]] == 0) {
         assert(captured_stones == 0);
+        record_op(false, i, m_parent[i]);
+        if (undo) {
+            undo->suicide = true;
+        }
         remove_string(i);
     }
 
@@ -207,6 +282,79 @@ int FullBoard::update_board(const int color, const int i) {
     return NO_VERTEX;
 }
 
+int FullBoard::restore_string(const MoveUndo::StringOp& op, const int color) {
+    int pos = op.vertex;
+    int restored = 0;
+
+    do {
+        m_state[pos] = vertex_t(color);
+        m_parent[pos] = op.parent;
+
+        add_neighbour(pos, color);
+
+        restored++;
+        pos = m_next[pos];
+    } while (pos != op.vertex);
+
+    /* the stones were appended to the empty list when removed */
+    m_empty_cnt -= restored;
+    m_libs[op.parent] = op.libs;
+
+    return restored;
+}
+
+void FullBoard::unplay_move(const MoveUndo& undo) {
+    const auto i = undo.vertex;
+    const auto color = undo.color;
+    auto op_count = undo.op_count;
+
+    assert(m_state[i] == color || (undo.suicide && m_state[i] == EMPTY));
+
+    if (undo.suicide) {
+        restore_string(undo.ops[--op_count], color);
+    }
+
+    /* put our position back into the empty list */
+    auto lastvertex = m_empty[undo.empty_idx];
+    m_empty[m_empty_cnt] = lastvertex;
+    m_empty_idx[lastvertex] = m_empty_cnt;
+    m_empty[undo.empty_idx] = i;
+    m_empty_idx[i] = undo.empty_idx;
+    m_empty_cnt++;
+
+    m_prisoners[color] = undo.prisoners;
+
+    /* split merged strings and restore captures, last one first */
+    while (op_count > 0) {
+        const auto& op = undo.ops[--op_count];
+        if (op.merge) {
+            std::swap(m_next[op.vertex], m_next[op.parent]);
+            int pos = op.vertex;
+            do {
+                m_parent[pos] = op.vertex;
+                pos = m_next[pos];
+            } while (pos != op.vertex);
+            m_libs[op.parent] = op.libs;
+            m_stones[op.parent] = op.stones;
+        } else {
+            restore_string(op, !color);
+        }
+    }
+
+    remove_neighbour(i, color);
+
+    m_state[i] = EMPTY;
+    m_parent[i] = NUM_VERTICES;
+    m_next[i] = undo.next;
+    m_libs[i] = undo.libs;
+    m_stones[i] = undo.stones;
+    m_libs[NUM_VERTICES] = undo.libs_sentinel;
+
+    m_hash = undo.hash;
+    m_ko_hash = undo.ko_hash;
+    m_sym_hash = undo.sym_hash;
+}
+
 void FullBoard::display_board(int lastmove) {
     FastBoard::display_board(lastmove);
 
@@ -218,4 +366,5 @@ void FullBoard::reset_board(int size) {
 
     m_hash = calc_hash();
     m_ko_hash = calc_ko_hash();
+    calc_sym_hash();
 }
@@ -31,16 +31,54 @@
 #define FULLBOARD_H_INCLUDED
 
 #include "config.h"
+#include <array>
 #include <cstdint>
 #include "FastBoard.h"
+#include "Zobrist.h"
 
 class FullBoard : public FastBoard {
 public:
+    /*
+        Everything update_board changes that can't be derived from the
+        board after the move, so unplay_move can take the move back.
+    */
+    struct MoveUndo {
+        /* a string merged into another one, or removed from the board */
+        struct StringOp {
+            bool merge;
+            unsigned short vertex;  /* merged parent or removed stone */
+            unsigned short parent;  /* parent it was merged into or had */
+            unsigned short libs;    /* liberties of parent before the op */
+            unsigned short stones;  /* stones of parent before the op */
+        };
+        /* up to 4 merges or captures, followed by a possible suicide */
+        std::array<StringOp, 5> ops;
+        int op_count;
+        bool suicide;
+
+        int vertex;
+        int color;
+        int empty_idx;
+        int prisoners;
+        /* stale contents of the played vertex */
+        unsigned short next;
+        unsigned short libs;
+        unsigned short stones;
+        unsigned short libs_sentinel;
+
+        std::uint64_t hash;
+        std::uint64_t ko_hash;
+        std::array<std::uint64_t, Zobrist::NUM_SYMMETRIES> sym_hash;
+    };
+
     int remove_string(int i);
-    int update_board(const int color, const int i);
+    int update_board(const int color, const int i,
+                     MoveUndo* undo = nullptr);
+    void unplay_move(const MoveUndo& undo);
 
     std::uint64_t get_hash() const;
     std::uint64_t get_ko_hash() const;
+    std::uint64_t get_symmetry_hash(int komove, int symmetry) const;
     void set_to_move(int tomove);
 
     void reset_board(int size);
@@ -54,6 +92,16 @@ public:
     std::uint64_t m_ko_hash;
 
 private:
+    /*
+        stone part of calc_symmetry_hash for every symmetry,
+        only meaningful when m_boardsize == BOARD_SIZE
+    */
+    std::array<std::uint64_t, Zobrist::NUM_SYMMETRIES> m_sym_hash;
+
+    void update_sym_hash(const Zobrist::SymmetryKeys& keys);
+    void calc_sym_hash();
+    int restore_string(const MoveUndo::StringOp& op, const int color);
+
     template<class Function>
     std::uint64_t calc_hash(int komove, Function transform) const;
 };
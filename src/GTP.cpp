@@ -44,12 +44,16 @@
 #include <boost/algorithm/string.hpp>
 
 #include "GTP.h"
+#include "BatchEvaluator.h"
 #include "FastBoard.h"
 #include "FullBoard.h"
 #include "GameState.h"
 #include "Network.h"
 #include "SGFTree.h"
 #include "SMP.h"
+#include "SearchBook.h"
+#include "SearchScheduler.h"
+#include "SelfPlay.h"
 #include "Training.h"
 #include "UCTSearch.h"
 #include "Utils.h"
@@ -65,7 +69,16 @@ int cfg_max_playouts;
 int cfg_max_visits;
 size_t cfg_max_memory;
 size_t cfg_max_tree_size;
+size_t cfg_session_memory;
 int cfg_max_cache_ratio_percent;
+bool cfg_canonical_cache;
+std::string cfg_nncache_file;
+size_t cfg_nncache_file_size;
+bool cfg_nncache_file_readonly;
+std::string cfg_book_file;
+int cfg_book_depth;
+int cfg_book_min_visits;
+bool cfg_book_update;
 TimeManagement::enabled_t cfg_timemanage;
 int cfg_lagbuffer_cs;
 int cfg_resignpct;
@@ -75,6 +88,12 @@ int cfg_random_min_visits;
 float cfg_random_temp;
 std::uint64_t cfg_rng_seed;
 bool cfg_dumbpass;
+bool cfg_binary_training;
+chunk_codec_t cfg_chunk_codec;
+int cfg_chunk_level;
+size_t cfg_shuffle_positions;
+training_symmetry_t cfg_training_symmetries;
+float cfg_validation_split;
 #ifdef USE_OPENCL
 std::vector<int> cfg_gpus;
 bool cfg_sgemm_exhaustive;
@@ -98,7 +117,8 @@ bool cfg_quiet;
 std::string cfg_options_str;
 bool cfg_benchmark;
 bool cfg_cpu_only;
-AnalyzeTags cfg_analyze_tags;
+unsigned short cfg_server_port;
+thread_local AnalyzeTags cfg_analyze_tags;
 
 /* Parses tags for the lz-analyze GTP command and friends */
 AnalyzeTags::AnalyzeTags(std::istringstream& cmdstream, const GameState& game) {
@@ -237,6 +257,20 @@ AnalyzeTags::AnalyzeTags(std::istringstream& cmdstream, const GameState& game) {
             if (cmdstream.fail()) {
                 return;
             }
+        } else if (tag == "format") {
+            std::string format;
+            cmdstream >> format;
+            if (format == "text") {
+                m_format = TEXT;
+            } else if (format == "json") {
+                m_format = JSON;
+            } else {
+                return;
+            }
+        } else if (tag == "deltas") {
+            m_deltas = true;
+        } else if (tag == "policy") {
+            m_with_policy = true;
         } else {
             return;
         }
@@ -267,6 +301,18 @@ size_t AnalyzeTags::post_move_count() const {
     return m_min_moves;
 }
 
+AnalyzeTags::format_t AnalyzeTags::format() const {
+    return m_format;
+}
+
+bool AnalyzeTags::deltas() const {
+    return m_deltas;
+}
+
+bool AnalyzeTags::with_policy() const {
+    return m_with_policy;
+}
+
 bool AnalyzeTags::is_to_avoid(int color, int vertex, size_t movenum) const {
     for (auto& move : m_moves_to_avoid) {
         if (color == move.color && vertex == move.vertex && movenum <= move.until_move) {
@@ -327,7 +373,16 @@ void GTP::setup_default_parameters() {
     cfg_max_visits = UCTSearch::UNLIMITED_PLAYOUTS;
     // This will be overwriiten in initialize() after network size is known.
     cfg_max_tree_size = UCTSearch::DEFAULT_MAX_MEMORY;
+    cfg_session_memory = 0;
     cfg_max_cache_ratio_percent = 10;
+    cfg_canonical_cache = false;
+    cfg_nncache_file = "";
+    cfg_nncache_file_size = 256 * MiB;
+    cfg_nncache_file_readonly = false;
+    cfg_book_file = "";
+    cfg_book_depth = 20;
+    cfg_book_min_visits = 1600;
+    cfg_book_update = false;
     cfg_timemanage = TimeManagement::AUTO;
     cfg_lagbuffer_cs = 100;
     cfg_weightsfile = leelaz_file("best-network");
@@ -355,6 +410,12 @@ void GTP::setup_default_parameters() {
     cfg_random_min_visits = 1;
     cfg_random_temp = 1.0f;
     cfg_dumbpass = false;
+    cfg_binary_training = false;
+    cfg_chunk_codec = chunk_codec_t::GZIP;
+    cfg_chunk_level = 9;
+    cfg_shuffle_positions = 0;
+    cfg_training_symmetries = training_symmetry_t::NONE;
+    cfg_validation_split = 0.0f;
     cfg_logfile_handle = nullptr;
     cfg_quiet = false;
     cfg_benchmark = false;
@@ -363,6 +424,7 @@ void GTP::setup_default_parameters() {
 #else
     cfg_cpu_only = false;
 #endif
+    cfg_server_port = 0;
 
     cfg_analyze_tags = AnalyzeTags{};
 
@@ -411,7 +473,13 @@ const std::string GTP::s_commands[] = {
     "lz-analyze",
     "lz-genmove_analyze",
     "lz-memory_report",
+    "lz-search_report",
     "lz-setoption",
+    "lz-selfplay",
+    "lz-evaluate_batch",
+    "lz-book_save",
+    "lz-tree_save",
+    "lz-tree_load",
     "gomill-explain_last_move",
     ""
 };
@@ -459,75 +527,32 @@ std::string GTP::get_life_list(const GameState & game, bool live) {
     return result;
 }
 
-void GTP::execute(GameState & game, const std::string& xinput) {
-    std::string input;
-    static auto search = std::make_unique<UCTSearch>(game, *s_network);
-
-    bool transform_lowercase = true;
-
-    // Required on Unixy systems
-    if (xinput.find("loadsgf") != std::string::npos) {
-        transform_lowercase = false;
-    }
-
-    /* eat empty lines, simple preprocessing, lower case */
-    for (unsigned int tmp = 0; tmp < xinput.size(); tmp++) {
-        if (xinput[tmp] == 9) {
-            input += " ";
-        } else if ((xinput[tmp] > 0 && xinput[tmp] <= 9)
-                || (xinput[tmp] >= 11 && xinput[tmp] <= 31)
-                || xinput[tmp] == 127) {
-               continue;
-        } else {
-            if (transform_lowercase) {
-                input += std::tolower(xinput[tmp]);
-            } else {
-                input += xinput[tmp];
-            }
-        }
-
-        // eat multi whitespace
-        if (input.size() > 1) {
-            if (std::isspace(input[input.size() - 2]) &&
-                std::isspace(input[input.size() - 1])) {
-                input.resize(input.size() - 1);
-            }
-        }
-    }
-
-    std::string command;
-    int id = -1;
+const GTP::CommandHandlers& GTP::get_command_handlers() {
+    static const auto s_handlers = make_command_handlers();
+    return s_handlers;
+}
 
-    if (input == "") {
-        return;
-    } else if (input == "exit") {
-        exit(EXIT_SUCCESS);
-    } else if (input.find("#") == 0) {
-        return;
-    } else if (std::isdigit(input[0])) {
-        std::istringstream strm(input);
-        char spacer;
-        strm >> id;
-        strm >> std::noskipws >> spacer;
-        std::getline(strm, command);
-    } else {
-        command = input;
-    }
+GTP::CommandHandlers GTP::make_command_handlers() {
+    auto handlers = CommandHandlers{};
 
-    /* process commands */
-    if (command == "protocol_version") {
+    handlers["protocol_version"] = [](GameState&, int id, const std::string&,
+                                      std::unique_ptr<UCTSearch>&) {
         gtp_printf(id, "%d", GTP_VERSION);
-        return;
-    } else if (command == "name") {
+    };
+
+    handlers["name"] = [](GameState&, int id, const std::string&,
+                          std::unique_ptr<UCTSearch>&) {
         gtp_printf(id, PROGRAM_NAME);
-        return;
-    } else if (command == "version") {
+    };
+
+    handlers["version"] = [](GameState&, int id, const std::string&,
+                             std::unique_ptr<UCTSearch>&) {
         gtp_printf(id, PROGRAM_VERSION);
-        return;
-    } else if (command == "quit") {
-        gtp_printf(id, "");
-        exit(EXIT_SUCCESS);
-    } else if (command.find("known_command") == 0) {
+    };
+
+    handlers["known_command"] = [](GameState&, int id,
+                                   const std::string& command,
+                                   std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
 
@@ -542,15 +567,20 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         }
 
         gtp_printf(id, "false");
-        return;
-    } else if (command.find("list_commands") == 0) {
+    };
+
+    handlers["list_commands"] = [](GameState&, int id, const std::string&,
+                                   std::unique_ptr<UCTSearch>&) {
         std::string outtmp(s_commands[0]);
         for (int i = 1; s_commands[i].size() > 0; i++) {
             outtmp = outtmp + "\n" + s_commands[i];
         }
         gtp_printf(id, outtmp.c_str());
-        return;
-    } else if (command.find("boardsize") == 0) {
+    };
+
+    handlers["boardsize"] = [](GameState& game, int id,
+                               const std::string& command,
+                               std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string stmp;
         int tmp;
@@ -570,16 +600,19 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
+    };
 
-        return;
-    } else if (command.find("clear_board") == 0) {
+    handlers["clear_board"] = [](GameState& game, int id, const std::string&,
+                                 std::unique_ptr<UCTSearch>& search) {
         Training::clear_training();
         game.reset_game();
         search = std::make_unique<UCTSearch>(game, *s_network);
         assert(UCTNodePointer::get_tree_size() == 0);
         gtp_printf(id, "");
-        return;
-    } else if (command.find("komi") == 0) {
+    };
+
+    handlers["komi"] = [](GameState& game, int id, const std::string& command,
+                          std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
         float komi = KOMI;
@@ -596,9 +629,10 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
+    };
 
-        return;
-    } else if (command.find("play") == 0) {
+    handlers["play"] = [](GameState& game, int id, const std::string& command,
+                          std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
         std::string color, vertex;
@@ -616,9 +650,10 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
-        return;
-    } else if (command.find("genmove") == 0
-               || command.find("lz-genmove_analyze") == 0) {
+    };
+
+    const auto genmove = [](GameState& game, int id, const std::string& command,
+                            std::unique_ptr<UCTSearch>& search) {
         auto analysis_output = command.find("lz-genmove_analyze") == 0;
 
         std::istringstream cmdstream(command);
@@ -681,8 +716,13 @@ void GTP::execute(GameState & game, const std::string& xinput) {
             gtp_printf_raw("\n");
         }
         cfg_analyze_tags = {};
-        return;
-    } else if (command.find("lz-analyze") == 0) {
+    };
+    handlers["genmove"] = genmove;
+    handlers["lz-genmove_analyze"] = genmove;
+
+    handlers["lz-analyze"] = [](GameState& game, int id,
+                                const std::string& command,
+                                std::unique_ptr<UCTSearch>& search) {
         std::istringstream cmdstream(command);
         std::string tmp;
 
@@ -705,8 +745,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         cfg_analyze_tags = {};
         // Terminate multi-line response
         gtp_printf_raw("\n");
-        return;
-    } else if (command.find("kgs-genmove_cleanup") == 0) {
+    };
+
+    handlers["kgs-genmove_cleanup"] = [](GameState& game, int id,
+                                         const std::string& command,
+                                         std::unique_ptr<UCTSearch>& search) {
         std::istringstream cmdstream(command);
         std::string tmp;
 
@@ -741,19 +784,25 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
-        return;
-    } else if (command.find("undo") == 0) {
+    };
+
+    handlers["undo"] = [](GameState& game, int id, const std::string&,
+                          std::unique_ptr<UCTSearch>&) {
         if (game.undo_move()) {
             gtp_printf(id, "");
         } else {
             gtp_fail_printf(id, "cannot undo");
         }
-        return;
-    } else if (command.find("showboard") == 0) {
+    };
+
+    handlers["showboard"] = [](GameState& game, int id, const std::string&,
+                               std::unique_ptr<UCTSearch>&) {
         gtp_printf(id, "");
         game.display_state();
-        return;
-    } else if (command.find("final_score") == 0) {
+    };
+
+    handlers["final_score"] = [](GameState& game, int id, const std::string&,
+                                 std::unique_ptr<UCTSearch>&) {
         float ftmp = game.final_score();
         /* white wins */
         if (ftmp < -0.1) {
@@ -763,8 +812,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_printf(id, "0");
         }
-        return;
-    } else if (command.find("final_status_list") == 0) {
+    };
+
+    handlers["final_status_list"] = [](GameState& game, int id,
+                                       const std::string& command,
+                                       std::unique_ptr<UCTSearch>&) {
         if (command.find("alive") != std::string::npos) {
             std::string livelist = get_life_list(game, true);
             gtp_printf(id, livelist.c_str());
@@ -774,8 +826,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_printf(id, "");
         }
-        return;
-    } else if (command.find("time_settings") == 0) {
+    };
+
+    handlers["time_settings"] = [](GameState& game, int id,
+                                   const std::string& command,
+                                   std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
         int maintime, byotime, byostones;
@@ -790,8 +845,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
-        return;
-    } else if (command.find("time_left") == 0) {
+    };
+
+    handlers["time_left"] = [](GameState& game, int id,
+                               const std::string& command,
+                               std::unique_ptr<UCTSearch>& search) {
         std::istringstream cmdstream(command);
         std::string tmp, color;
         int time, stones;
@@ -824,24 +882,30 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
-        return;
-    } else if (command.find("auto") == 0) {
+    };
+
+    handlers["auto"] = [](GameState& game, int, const std::string&,
+                          std::unique_ptr<UCTSearch>& search) {
         do {
             int move = search->think(game.get_to_move(), UCTSearch::NORMAL);
             game.play_move(move);
             game.display_state();
 
         } while (game.get_passes() < 2 && !game.has_resigned());
+    };
 
-        return;
-    } else if (command.find("go") == 0 && command.size() < 6) {
+    handlers["go"] = [](GameState& game, int, const std::string&,
+                        std::unique_ptr<UCTSearch>& search) {
         int move = search->think(game.get_to_move());
         game.play_move(move);
 
         std::string vertex = game.move_to_text(move);
         myprintf("%s\n", vertex.c_str());
-        return;
-    } else if (command.find("heatmap") == 0) {
+    };
+
+    handlers["heatmap"] = [](GameState& game, int id,
+                             const std::string& command,
+                             std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
         std::string symmetry;
@@ -874,8 +938,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         }
 
         gtp_printf(id, "");
-        return;
-    } else if (command.find("fixed_handicap") == 0) {
+    };
+
+    handlers["fixed_handicap"] = [](GameState& game, int id,
+                                    const std::string& command,
+                                    std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
         int stones;
@@ -889,8 +956,10 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "Not a valid number of handicap stones");
         }
-        return;
-    } else if (command.find("last_move") == 0) {
+    };
+
+    handlers["last_move"] = [](GameState& game, int id, const std::string&,
+                               std::unique_ptr<UCTSearch>&) {
         auto last_move = game.get_last_move();
         if (last_move == FastBoard::NO_VERTEX) {
             gtp_fail_printf(id, "no previous move known");
@@ -899,8 +968,10 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         auto coordinate = game.move_to_text(last_move);
         auto color = game.get_to_move() == FastBoard::WHITE ? "black" : "white";
         gtp_printf(id, "%s %s", color, coordinate.c_str());
-        return;
-    } else if (command.find("move_history") == 0) {
+    };
+
+    handlers["move_history"] = [](GameState& game, int id, const std::string&,
+                                  std::unique_ptr<UCTSearch>&) {
         gtp_printf_raw("=%s %s",
                        id == -1 ? "" : std::to_string(id).c_str(),
                        game.get_movenum() == 0 ? "\n" : "");
@@ -916,12 +987,22 @@ void GTP::execute(GameState & game, const std::string& xinput) {
             gtp_printf_raw("%s %s\n", color, coordinate.c_str());
         }
         gtp_printf_raw("\n");
-        return;
-    } else if (command.find("clear_cache") == 0) {
+    };
+
+    handlers["clear_cache"] = [](GameState&, int id, const std::string&,
+                                 std::unique_ptr<UCTSearch>&) {
+        // Server sessions share the cache, one must not clear it for all.
+        if (cfg_server_port) {
+            gtp_fail_printf(id, "cache is shared by all sessions");
+            return;
+        }
         s_network->nncache_clear();
         gtp_printf(id, "");
-        return;
-    } else if (command.find("place_free_handicap") == 0) {
+    };
+
+    handlers["place_free_handicap"] = [](GameState& game, int id,
+                                         const std::string& command,
+                                         std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
         int stones;
@@ -936,9 +1017,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "Not a valid number of handicap stones");
         }
+    };
 
-        return;
-    } else if (command.find("set_free_handicap") == 0) {
+    handlers["set_free_handicap"] = [](GameState& game, int id,
+                                       const std::string& command,
+                                       std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
 
@@ -960,12 +1043,15 @@ void GTP::execute(GameState & game, const std::string& xinput) {
 
         std::string stonestring = game.board.get_stone_list();
         gtp_printf(id, "%s", stonestring.c_str());
+    };
 
-        return;
-    } else if (command.find("loadsgf") == 0) {
+    handlers["loadsgf"] = [](GameState& game, int id,
+                             const std::string& command,
+                             std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp, filename;
         int movenum;
+        int gamenum;
 
         cmdstream >> tmp;   // eat loadsgf
         cmdstream >> filename;
@@ -976,22 +1062,31 @@ void GTP::execute(GameState & game, const std::string& xinput) {
             if (cmdstream.fail()) {
                 movenum = 999;
             }
+            // optional game number in multi-game files, 1-based
+            cmdstream >> gamenum;
+            if (cmdstream.fail() || gamenum < 1) {
+                gamenum = 1;
+            }
         } else {
             gtp_fail_printf(id, "Missing filename.");
             return;
         }
 
         auto sgftree = std::make_unique<SGFTree>();
+        // only the main line gets replayed, don't set up variations
+        sgftree->set_checkpoint_interval(SGFTree::DEFAULT_CHECKPOINT_INTERVAL);
 
         try {
-            sgftree->load_from_file(filename);
+            sgftree->load_from_file(filename, gamenum - 1);
             game = sgftree->follow_mainline_state(movenum - 1);
             gtp_printf(id, "");
         } catch (const std::exception&) {
             gtp_fail_printf(id, "cannot load file");
         }
-        return;
-    } else if (command.find("kgs-chat") == 0) {
+    };
+
+    handlers["kgs-chat"] = [](GameState&, int id, const std::string& command,
+                              std::unique_ptr<UCTSearch>&) {
         // kgs-chat (game|private) Name Message
         std::istringstream cmdstream(command);
         std::string tmp;
@@ -1004,12 +1099,17 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } while (!cmdstream.fail());
 
         gtp_fail_printf(id, "I'm a go bot, not a chat bot.");
-        return;
-    } else if (command.find("kgs-game_over") == 0) {
+    };
+
+    handlers["kgs-game_over"] = [](GameState&, int id, const std::string&,
+                                   std::unique_ptr<UCTSearch>&) {
         // Do nothing. Particularly, don't ponder.
         gtp_printf(id, "");
-        return;
-    } else if (command.find("kgs-time_settings") == 0) {
+    };
+
+    handlers["kgs-time_settings"] = [](GameState& game, int id,
+                                       const std::string& command,
+                                       std::unique_ptr<UCTSearch>&) {
         // none, absolute, byoyomi, or canadian
         std::istringstream cmdstream(command);
         std::string tmp;
@@ -1042,8 +1142,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
-        return;
-    } else if (command.find("netbench") == 0) {
+    };
+
+    handlers["netbench"] = [](GameState& game, int id,
+                              const std::string& command,
+                              std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp;
         int iterations;
@@ -1057,9 +1160,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
             s_network->benchmark(&game);
         }
         gtp_printf(id, "");
-        return;
+    };
 
-    } else if (command.find("printsgf") == 0) {
+    handlers["printsgf"] = [](GameState& game, int id,
+                              const std::string& command,
+                              std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp, filename;
 
@@ -1079,9 +1184,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
             out.close();
             gtp_printf(id, "");
         }
+    };
 
-        return;
-    } else if (command.find("load_training") == 0) {
+    handlers["load_training"] = [](GameState&, int id,
+                                   const std::string& command,
+                                   std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp, filename;
 
@@ -1095,9 +1202,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
+    };
 
-        return;
-    } else if (command.find("save_training") == 0) {
+    handlers["save_training"] = [](GameState&, int id,
+                                   const std::string& command,
+                                   std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp, filename;
 
@@ -1111,9 +1220,11 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
+    };
 
-        return;
-    } else if (command.find("dump_training") == 0) {
+    handlers["dump_training"] = [](GameState&, int id,
+                                   const std::string& command,
+                                   std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp, winner_color, filename;
         int who_won;
@@ -1137,9 +1248,10 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
+    };
 
-        return;
-    } else if (command.find("dump_debug") == 0) {
+    handlers["dump_debug"] = [](GameState&, int id, const std::string& command,
+                                std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp, filename;
 
@@ -1153,24 +1265,106 @@ void GTP::execute(GameState & game, const std::string& xinput) {
         } else {
             gtp_fail_printf(id, "syntax not understood");
         }
+    };
 
-        return;
-    } else if (command.find("dump_supervised") == 0) {
+    handlers["dump_supervised"] = [](GameState&, int id,
+                                     const std::string& command,
+                                     std::unique_ptr<UCTSearch>&) {
         std::istringstream cmdstream(command);
         std::string tmp, sgfname, outname;
+        size_t threads;
 
         // tmp will eat dump_supervised
         cmdstream >> tmp >> sgfname >> outname;
 
-        Training::dump_supervised(sgfname, outname);
+        if (cmdstream.fail()) {
+            gtp_fail_printf(id, "syntax not understood");
+            return;
+        }
 
-        if (!cmdstream.fail()) {
-            gtp_printf(id, "");
+        // With a thread count, stream the file and write
+        // a set of chunks per thread.
+        if (cmdstream >> threads) {
+            Training::dump_supervised(sgfname, outname, threads);
         } else {
+            Training::dump_supervised(sgfname, outname);
+        }
+        OutputChunker::wait_for_writes();
+        gtp_printf(id, "");
+    };
+
+    handlers["lz-selfplay"] = [](GameState& game, int id,
+                                 const std::string& command,
+                                 std::unique_ptr<UCTSearch>&) {
+        // lz-selfplay games parallel prefix
+        std::istringstream cmdstream(command);
+        std::string tmp, prefix;
+        size_t games, parallel;
+
+        cmdstream >> tmp >> games >> parallel >> prefix;
+
+        if (cmdstream.fail() || games == 0 || parallel == 0) {
+            gtp_fail_printf(id, "syntax not understood");
+            return;
+        }
+
+        SelfPlay::run(*s_network, game.get_komi(), games, parallel, prefix);
+        gtp_printf(id, "");
+    };
+
+    handlers["lz-evaluate_batch"] = [](GameState&, int id,
+                                       const std::string& command,
+                                       std::unique_ptr<UCTSearch>&) {
+        // lz-evaluate_batch sgffile outfile [positionsfile]
+        std::istringstream cmdstream(command);
+        std::string tmp, sgfname, outname, positionsname;
+
+        cmdstream >> tmp >> sgfname >> outname;
+
+        if (cmdstream.fail()) {
             gtp_fail_printf(id, "syntax not understood");
+            return;
         }
-        return;
-    } else if (command.find("lz-memory_report") == 0) {
+        cmdstream >> positionsname;
+
+        try {
+            auto selection = BatchEvaluator::Selection{};
+            if (!positionsname.empty()) {
+                selection = BatchEvaluator::read_selection(positionsname);
+            }
+            auto positions = BatchEvaluator::run(*s_network, sgfname, outname,
+                                                 cfg_num_threads, selection);
+            gtp_printf(id, "%d", int(positions));
+        } catch (const std::exception& e) {
+            gtp_fail_printf(id, "%s", e.what());
+        }
+    };
+
+    handlers["convert_training"] = [](GameState&, int id,
+                                      const std::string& command,
+                                      std::unique_ptr<UCTSearch>&) {
+        std::istringstream cmdstream(command);
+        std::string tmp, inname, outname;
+
+        // tmp will eat convert_training
+        cmdstream >> tmp >> inname >> outname;
+
+        if (cmdstream.fail()) {
+            gtp_fail_printf(id, "syntax not understood");
+            return;
+        }
+
+        try {
+            Training::convert_chunk(inname, outname);
+        } catch (const std::exception& e) {
+            gtp_fail_printf(id, "%s", e.what());
+            return;
+        }
+        gtp_printf(id, "");
+    };
+
+    handlers["lz-memory_report"] = [](GameState&, int id, const std::string&,
+                                      std::unique_ptr<UCTSearch>&) {
         auto base_memory = get_base_memory();
         auto tree_size = add_overhead(UCTNodePointer::get_tree_size());
         auto cache_size = add_overhead(s_network->get_estimated_cache_size());
@@ -1180,15 +1374,148 @@ void GTP::execute(GameState & game, const std::string& xinput) {
             "Estimated total memory consumption: %d MiB.\n"
             "Network with overhead: %d MiB / Search tree: %d MiB / Network cache: %d\n",
             total / MiB, base_memory / MiB, tree_size / MiB, cache_size / MiB);
-        return;
-    } else if (command.find("lz-setoption") == 0) {
+    };
+
+    handlers["lz-search_report"] = [](GameState&, int id, const std::string&,
+                                      std::unique_ptr<UCTSearch>&) {
+        // playouts/s and queue wait of every search in the process
+        gtp_printf(id, "%s", SearchScheduler::get().report().c_str());
+    };
+
+    handlers["lz-book_save"] = [](GameState&, int id,
+                                  const std::string& command,
+                                  std::unique_ptr<UCTSearch>&) {
+        // lz-book_save [filename], by default the --book file
+        std::istringstream cmdstream(command);
+        std::string tmp, filename;
+
+        cmdstream >> tmp >> filename;
+        if (filename.empty()) {
+            filename = cfg_book_file;
+        }
+        if (filename.empty()) {
+            gtp_fail_printf(id, "syntax not understood");
+            return;
+        }
+
+        try {
+            SearchBook::get().save(filename);
+            gtp_printf(id, "%d", int(SearchBook::get().size()));
+        } catch (const std::exception&) {
+            gtp_fail_printf(id, "cannot save file");
+        }
+    };
+
+    const auto tree_file = [](GameState&, int id, const std::string& command,
+                              std::unique_ptr<UCTSearch>& search) {
+        // lz-tree_save filename, lz-tree_load filename
+        std::istringstream cmdstream(command);
+        std::string tmp, filename;
+
+        cmdstream >> tmp >> filename;
+        if (cmdstream.fail()) {
+            gtp_fail_printf(id, "syntax not understood");
+            return;
+        }
+
+        try {
+            const auto visits = tmp == "lz-tree_save"
+                ? search->save_tree(filename)
+                : search->load_tree(filename);
+            gtp_printf(id, "%d", visits);
+        } catch (const std::exception& e) {
+            gtp_fail_printf(id, "%s", e.what());
+        }
+    };
+    handlers["lz-tree_save"] = tree_file;
+    handlers["lz-tree_load"] = tree_file;
+
+    handlers["lz-setoption"] = [](GameState&, int id,
+                                  const std::string& command,
+                                  std::unique_ptr<UCTSearch>& search) {
+        // Options are process wide, memory limits included.
+        if (cfg_server_port) {
+            gtp_fail_printf(id, "options are shared by all sessions");
+            return;
+        }
         return execute_setoption(*search.get(), id, command);
-    } else if (command.find("gomill-explain_last_move") == 0) {
+    };
+
+    handlers["gomill-explain_last_move"] = [](GameState&, int id,
+                                              const std::string&,
+                                              std::unique_ptr<UCTSearch>& search) {
         gtp_printf(id, "%s\n", search->explain_last_think().c_str());
-        return;
+    };
+
+    return handlers;
+}
+
+bool GTP::execute(GameState & game, const std::string& xinput) {
+    std::string input;
+    // one search per thread, server sessions each run on their own
+    static thread_local auto search = std::make_unique<UCTSearch>(game, *s_network);
+
+    bool transform_lowercase = true;
+
+    // Required on Unixy systems
+    if (xinput.find("loadsgf") != std::string::npos) {
+        transform_lowercase = false;
     }
-    gtp_fail_printf(id, "unknown command");
-    return;
+
+    /* eat empty lines, simple preprocessing, lower case */
+    input.reserve(xinput.size());
+    for (auto c : xinput) {
+        if (c == 9) {
+            c = ' ';
+        } else if ((c > 0 && c <= 9) || (c >= 11 && c <= 31) || c == 127) {
+            continue;
+        } else if (transform_lowercase) {
+            c = std::tolower(static_cast<unsigned char>(c));
+        }
+
+        // eat multi whitespace
+        if (!input.empty()
+            && std::isspace(static_cast<unsigned char>(c))
+            && std::isspace(static_cast<unsigned char>(input.back()))) {
+            continue;
+        }
+        input += c;
+    }
+
+    std::string command;
+    int id = -1;
+
+    if (input == "") {
+        return true;
+    } else if (input == "exit") {
+        return false;
+    } else if (input.find("#") == 0) {
+        return true;
+    } else if (std::isdigit(input[0])) {
+        std::istringstream strm(input);
+        char spacer;
+        strm >> id;
+        strm >> std::noskipws >> spacer;
+        std::getline(strm, command);
+    } else {
+        command = input;
+    }
+
+    const auto name = command.substr(0, command.find(' '));
+    // The caller decides what quitting ends: the process or a session.
+    if (name == "quit") {
+        gtp_printf(id, "");
+        return false;
+    }
+
+    const auto& handlers = get_command_handlers();
+    const auto handler = handlers.find(name);
+    if (handler == end(handlers)) {
+        gtp_fail_printf(id, "unknown command");
+        return true;
+    }
+    handler->second(game, id, command, search);
+    return true;
 }
 
 std::pair<std::string, std::string> GTP::parse_option(std::istringstream& is) {
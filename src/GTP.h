@@ -34,6 +34,7 @@
 
 #include <cstdio>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "Network.h"
@@ -59,6 +60,10 @@ class AnalyzeTags {
     friend class LeelaTest;
 
 public:
+    enum format_t {
+        TEXT, JSON
+    };
+
     AnalyzeTags() = default;
     AnalyzeTags(std::istringstream& cmdstream, const GameState& game);
 
@@ -68,6 +73,9 @@ public:
     int invalid() const;
     int who() const;
     size_t post_move_count() const;
+    format_t format() const;
+    bool deltas() const;
+    bool with_policy() const;
     bool is_to_avoid(int color, int vertex, size_t movenum) const;
     bool has_move_restrictions() const;
 
@@ -77,6 +85,9 @@ private:
     int m_interval_centis{0};
     int m_who{FastBoard::INVAL};
     size_t m_min_moves{0};
+    format_t m_format{TEXT};
+    bool m_deltas{false};
+    bool m_with_policy{false};
 };
 
 extern bool cfg_gtp_mode;
@@ -87,7 +98,16 @@ extern int cfg_max_playouts;
 extern int cfg_max_visits;
 extern size_t cfg_max_memory;
 extern size_t cfg_max_tree_size;
+extern size_t cfg_session_memory;
 extern int cfg_max_cache_ratio_percent;
+extern bool cfg_canonical_cache;
+extern std::string cfg_nncache_file;
+extern size_t cfg_nncache_file_size;
+extern bool cfg_nncache_file_readonly;
+extern std::string cfg_book_file;
+extern int cfg_book_depth;
+extern int cfg_book_min_visits;
+extern bool cfg_book_update;
 extern TimeManagement::enabled_t cfg_timemanage;
 extern int cfg_lagbuffer_cs;
 extern int cfg_resignpct;
@@ -97,6 +117,18 @@ extern int cfg_random_min_visits;
 extern float cfg_random_temp;
 extern std::uint64_t cfg_rng_seed;
 extern bool cfg_dumbpass;
+extern bool cfg_binary_training;
+enum class chunk_codec_t {
+    GZIP, ZSTD
+};
+extern chunk_codec_t cfg_chunk_codec;
+extern int cfg_chunk_level;
+extern size_t cfg_shuffle_positions;
+enum class training_symmetry_t {
+    NONE, RANDOM, ALL
+};
+extern training_symmetry_t cfg_training_symmetries;
+extern float cfg_validation_split;
 #ifdef USE_OPENCL
 extern std::vector<int> cfg_gpus;
 extern bool cfg_sgemm_exhaustive;
@@ -123,7 +155,8 @@ extern bool cfg_quiet;
 extern std::string cfg_options_str;
 extern bool cfg_benchmark;
 extern bool cfg_cpu_only;
-extern AnalyzeTags cfg_analyze_tags;
+extern unsigned short cfg_server_port;
+extern thread_local AnalyzeTags cfg_analyze_tags;
 
 static constexpr size_t MiB = 1024LL * 1024LL;
 
@@ -136,11 +169,20 @@ class GTP {
 public:
     static std::unique_ptr<Network> s_network;
     static void initialize(std::unique_ptr<Network>&& network);
-    static void execute(GameState & game, const std::string& xinput);
+    // Returns false once the input asks to quit.
+    static bool execute(GameState & game, const std::string& xinput);
     static void setup_default_parameters();
 private:
     static constexpr int GTP_VERSION = 2;
 
+    // Commands are looked up by their first word.
+    using CommandHandler = void (*)(GameState& game, int id,
+                                    const std::string& command,
+                                    std::unique_ptr<UCTSearch>& search);
+    using CommandHandlers = std::unordered_map<std::string, CommandHandler>;
+    static CommandHandlers make_command_handlers();
+    static const CommandHandlers& get_command_handlers();
+
     static std::string get_life_list(const GameState & game, bool live);
     static const std::string s_commands[];
     static const std::string s_options[];
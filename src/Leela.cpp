@@ -46,6 +46,8 @@
 #include "Network.h"
 #include "NNCache.h"
 #include "Random.h"
+#include "SearchBook.h"
+#include "Server.h"
 #include "ThreadPool.h"
 #include "Utils.h"
 #include "Zobrist.h"
@@ -136,6 +138,12 @@ static void parse_commandline(int argc, char *argv[]) {
     gen_desc.add_options()
         ("help,h", "Show commandline options.")
         ("gtp,g", "Enable GTP mode.")
+        ("server", po::value<unsigned short>(),
+                   "Serve GTP sessions on this localhost TCP port instead "
+                   "of stdin, one board and search per connection.")
+        ("session-memory", po::value<int>(),
+                           "Tree memory of each server session in MiB, "
+                           "0 for only the global limit.")
         ("threads,t", po::value<unsigned int>()->default_value(0),
                       "Number of threads to use. Select 0 to let leela-zero pick a reasonable default.")
         ("playouts,p", po::value<int>(),
@@ -159,6 +167,23 @@ static void parse_commandline(int argc, char *argv[]) {
                        "fast = Same as on but always plays faster.\n"
                        "no_pruning = For self play training use.\n")
         ("noponder", "Disable thinking on opponent's time.")
+        ("canonical-cache", "Key the NN cache on the canonical board "
+                            "orientation, so one entry serves all 8 "
+                            "symmetric positions. Ignored in self-play.")
+        ("nncache-file", po::value<std::string>(),
+                         "Keep network results in this file across runs.")
+        ("nncache-file-size", po::value<int>()->default_value(256),
+                              "Size of the NN cache file in MiB.")
+        ("nncache-file-readonly", "Only read the NN cache file, so it can "
+                                  "be shared with a process writing it.")
+        ("book", po::value<std::string>(),
+                 "Play opening moves from this file of earlier searches.")
+        ("book-depth", po::value<int>()->default_value(cfg_book_depth),
+                       "Only use the book for this many moves.")
+        ("book-min-visits", po::value<int>()->default_value(cfg_book_min_visits),
+                            "Only use book positions searched with at least "
+                            "this many visits.")
+        ("book-update", "Add searches to the book and write it on exit.")
         ("benchmark", "Test network and exit. Default args:\n-v3200 --noponder "
                       "-m0 -t1 -s1.")
 #ifndef USE_CPU_ONLY
@@ -186,6 +211,20 @@ static void parse_commandline(int argc, char *argv[]) {
         ("seed,s", po::value<std::uint64_t>(),
                    "Random number generation seed.")
         ("dumbpass,d", "Don't use heuristics for smarter passing.")
+        ("binary-training", "Write training chunks in the packed binary "
+                            "format instead of text.")
+        ("chunk-codec", po::value<std::string>()->default_value("gzip"),
+                        "[gzip|zstd] Compression of training chunks.")
+        ("chunk-level", po::value<int>()->default_value(cfg_chunk_level),
+                        "Compression level of training chunks.")
+        ("shuffle-positions", po::value<size_t>()->default_value(cfg_shuffle_positions),
+                        "Shuffle training positions through a buffer "
+                        "of this many positions, 0 to keep game order.")
+        ("validation-split", po::value<float>()->default_value(cfg_validation_split),
+                        "Fraction of games written to the validation chunks.")
+        ("training-symmetries", po::value<std::string>()->default_value("none"),
+                        "[none|random|all] Write training positions in a "
+                        "random orientation, or in all 8 of them.")
         ("randomcnt,m", po::value<int>()->default_value(cfg_random_cnt),
                         "Play more randomly the first x moves.")
         ("randomvisits",
@@ -306,6 +345,20 @@ static void parse_commandline(int argc, char *argv[]) {
         cfg_gtp_mode = true;
     }
 
+    if (vm.count("server")) {
+        cfg_server_port = vm["server"].as<unsigned short>();
+        cfg_gtp_mode = true;
+    }
+
+    if (vm.count("session-memory")) {
+        const auto session_memory = vm["session-memory"].as<int>();
+        if (session_memory < 0) {
+            printf("Session memory must be at least 0.\n");
+            exit(EXIT_FAILURE);
+        }
+        cfg_session_memory = size_t(session_memory) * MiB;
+    }
+
 #ifdef USE_OPENCL
     if (vm.count("gpu")) {
         cfg_gpus = vm["gpu"].as<std::vector<int> >();
@@ -380,10 +433,88 @@ static void parse_commandline(int argc, char *argv[]) {
         cfg_noise = true;
     }
 
+    if (vm.count("canonical-cache")) {
+        cfg_canonical_cache = true;
+    }
+
+    if (vm.count("nncache-file")) {
+        cfg_nncache_file = vm["nncache-file"].as<std::string>();
+        const auto file_size = vm["nncache-file-size"].as<int>();
+        if (file_size < 1) {
+            printf("NN cache file size must be at least 1 MiB.\n");
+            exit(EXIT_FAILURE);
+        }
+        cfg_nncache_file_size = size_t(file_size) * MiB;
+        cfg_nncache_file_readonly = vm.count("nncache-file-readonly") > 0;
+    }
+
+    if (vm.count("book")) {
+        cfg_book_file = vm["book"].as<std::string>();
+        cfg_book_depth = vm["book-depth"].as<int>();
+        cfg_book_min_visits = vm["book-min-visits"].as<int>();
+        if (cfg_book_min_visits < 1) {
+            printf("Book positions need at least 1 visit.\n");
+            exit(EXIT_FAILURE);
+        }
+        cfg_book_update = vm.count("book-update") > 0;
+    } else if (vm.count("book-update")) {
+        printf("--book-update needs a --book file.\n");
+        exit(EXIT_FAILURE);
+    }
+
     if (vm.count("dumbpass")) {
         cfg_dumbpass = true;
     }
 
+    if (vm.count("binary-training")) {
+        cfg_binary_training = true;
+    }
+
+    if (vm.count("chunk-codec")) {
+        auto codec = vm["chunk-codec"].as<std::string>();
+        if (codec == "gzip") {
+            cfg_chunk_codec = chunk_codec_t::GZIP;
+#ifdef USE_ZSTD
+        } else if (codec == "zstd") {
+            cfg_chunk_codec = chunk_codec_t::ZSTD;
+#endif
+        } else {
+            printf("Unsupported chunk codec: %s\n", codec.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (vm.count("chunk-level")) {
+        cfg_chunk_level = vm["chunk-level"].as<int>();
+    }
+
+    if (vm.count("shuffle-positions")) {
+        cfg_shuffle_positions = vm["shuffle-positions"].as<size_t>();
+    }
+
+    if (vm.count("training-symmetries")) {
+        auto symmetries = vm["training-symmetries"].as<std::string>();
+        if (symmetries == "none") {
+            cfg_training_symmetries = training_symmetry_t::NONE;
+        } else if (symmetries == "random") {
+            cfg_training_symmetries = training_symmetry_t::RANDOM;
+        } else if (symmetries == "all") {
+            cfg_training_symmetries = training_symmetry_t::ALL;
+        } else {
+            printf("Unexpected option for --training-symmetries, expecting "
+                   "none/random/all\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (vm.count("validation-split")) {
+        cfg_validation_split = vm["validation-split"].as<float>();
+        if (cfg_validation_split < 0.0f || cfg_validation_split >= 1.0f) {
+            printf("Validation split must be in [0, 1).\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     if (vm.count("playouts")) {
         cfg_max_playouts = vm["playouts"].as<int>();
         if (!vm.count("noponder")) {
@@ -490,6 +621,39 @@ static void initialize_network() {
     GTP::initialize(std::move(network));
 }
 
+static void save_book() {
+    try {
+        SearchBook::get().save(cfg_book_file);
+        myprintf("Wrote %zu book positions to %s.\n",
+                 SearchBook::get().size(), cfg_book_file.c_str());
+    } catch (const std::exception& e) {
+        myprintf("Could not write book %s: %s.\n",
+                 cfg_book_file.c_str(), e.what());
+    }
+}
+
+static void initialize_book() {
+    if (cfg_book_file.empty()) {
+        return;
+    }
+    try {
+        SearchBook::get().load(cfg_book_file);
+        myprintf("Loaded %zu book positions from %s.\n",
+                 SearchBook::get().size(), cfg_book_file.c_str());
+    } catch (const std::exception& e) {
+        if (!cfg_book_update) {
+            printf("Could not read book %s: %s.\n",
+                   cfg_book_file.c_str(), e.what());
+            exit(EXIT_FAILURE);
+        }
+        myprintf("Starting a new book in %s.\n", cfg_book_file.c_str());
+    }
+    if (cfg_book_update) {
+        // Also covers the quit command, which exits right away.
+        std::atexit(save_book);
+    }
+}
+
 // Setup global objects after command line has been parsed
 void init_global_objects() {
     thread_pool.initialize(cfg_num_threads);
@@ -506,6 +670,7 @@ void init_global_objects() {
     Utils::create_z_table();
 
     initialize_network();
+    initialize_book();
 }
 
 void benchmark(GameState& game) {
@@ -536,7 +701,12 @@ int main(int argc, char *argv[]) {
     std::cerr.setf(std::ios::unitbuf);
     std::cin.setf(std::ios::unitbuf);
 
-    setbuf(stdout, nullptr);
+    if (cfg_gtp_mode) {
+        // GTP responses flush it themselves, see Utils::gtp_printf.
+        setvbuf(stdout, nullptr, _IOFBF, 64 * 1024);
+    } else {
+        setbuf(stdout, nullptr);
+    }
     setbuf(stderr, nullptr);
 #ifndef _WIN32
     setbuf(stdin, nullptr);
@@ -559,16 +729,36 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    if (cfg_server_port) {
+        Server::run(cfg_server_port);
+        return 0;
+    }
+
+    // Searches poll for new commands after every playout, so they are
+    // read ahead on a thread of their own.
+    Utils::LineReader reader([](std::string& line) {
+        return bool(std::getline(std::cin, line));
+    });
+    Utils::set_stdin_reader(&reader);
+
     for (;;) {
         if (!cfg_gtp_mode) {
             maingame->display_state();
             std::cout << "Leela: ";
         }
 
+        // Replies skip the flush while more commands are queued, and
+        // blank or comment lines send none, so flush before waiting.
+        if (!reader.pending()) {
+            fflush(stdout);
+        }
+
         auto input = std::string{};
-        if (std::getline(std::cin, input)) {
+        if (reader.get_line(input)) {
             Utils::log_input(input);
-            GTP::execute(*maingame, input);
+            if (!GTP::execute(*maingame, input)) {
+                exit(EXIT_SUCCESS);
+            }
         } else {
             // eof or other error
             std::cout << std::endl;
@@ -577,8 +767,7 @@ int main(int argc, char *argv[]) {
 
         // Force a flush of the logfile
         if (cfg_logfile_handle) {
-            fclose(cfg_logfile_handle);
-            cfg_logfile_handle = fopen(cfg_logfile.c_str(), "a");
+            fflush(cfg_logfile_handle);
         }
     }
 
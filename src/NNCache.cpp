@@ -32,6 +32,7 @@
 #include <memory>
 
 #include "NNCache.h"
+#include "NNCacheFile.h"
 #include "Utils.h"
 #include "UCTSearch.h"
 #include "GTP.h"
@@ -42,32 +43,71 @@ const size_t NNCache::ENTRY_SIZE;
 
 NNCache::NNCache(int size) : m_size(size) {}
 
-bool NNCache::lookup(std::uint64_t hash, Netresult & result) {
+NNCache::~NNCache() = default;
+
+void NNCache::attach_file(std::unique_ptr<NNCacheFile> file) {
     std::lock_guard<std::mutex> lock(m_mutex);
-    ++m_lookups;
+    m_file = std::move(file);
+}
 
-    auto iter = m_cache.find(hash);
-    if (iter == m_cache.end()) {
-        return false;  // Not found.
+bool NNCache::lookup(std::uint64_t hash, Netresult & result) {
+    auto symmetry = 0;
+    return lookup(hash, result, symmetry);
+}
+
+bool NNCache::lookup(std::uint64_t hash, Netresult & result, int & symmetry) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_lookups;
+
+        auto iter = m_cache.find(hash);
+        if (iter != m_cache.end()) {
+            const auto& entry = iter->second;
+
+            // Found it.
+            ++m_hits;
+            result = entry->result;
+            symmetry = entry->symmetry;
+            return true;
+        }
     }
 
-    const auto& entry = iter->second;
+    // A page fault in the file must not hold up the other threads.
+    if (!m_file || !m_file->lookup(hash, result, symmetry)) {
+        return false;  // Not found.
+    }
 
-    // Found it.
+    // Keep it in memory, it is likely to be needed again.
+    std::lock_guard<std::mutex> lock(m_mutex);
     ++m_hits;
-    result = entry->result;
+    ++m_file_hits;
+    if (m_cache.find(hash) == m_cache.end()) {
+        insert_locked(hash, result, symmetry);
+    }
     return true;
 }
 
 void NNCache::insert(std::uint64_t hash,
-                     const Netresult& result) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-
-    if (m_cache.find(hash) != m_cache.end()) {
-        return;  // Already in the cache.
+                     const Netresult& result,
+                     const int symmetry) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_cache.find(hash) != m_cache.end()) {
+            return;  // Already in the cache.
+        }
+        insert_locked(hash, result, symmetry);
     }
+    if (m_file) {
+        m_file->insert(hash, result, symmetry);
+    }
+}
 
-    m_cache.emplace(hash, std::make_unique<Entry>(result));
+void NNCache::insert_locked(std::uint64_t hash,
+                            const Netresult& result,
+                            const int symmetry) {
+
+    m_cache.emplace(hash, std::make_unique<Entry>(result, symmetry));
     m_order.push_back(hash);
     ++m_inserts;
 
@@ -109,6 +149,10 @@ void NNCache::dump_stats() {
         "NNCache: %d/%d hits/lookups = %.1f%% hitrate, %d inserts, %u size\n",
         m_hits, m_lookups, 100. * m_hits / (m_lookups + 1),
         m_inserts, m_cache.size());
+    if (m_file) {
+        Utils::myprintf("NNCache: %d hits from file of %zu entries\n",
+                        m_file_hits, m_file->get_entry_count());
+    }
 }
 
 size_t NNCache::get_estimated_size() {
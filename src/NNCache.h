@@ -38,6 +38,8 @@
 #include <mutex>
 #include <unordered_map>
 
+class NNCacheFile;
+
 class NNCache {
 public:
 
@@ -64,24 +66,34 @@ public:
 
     static constexpr size_t ENTRY_SIZE =
           sizeof(Netresult)
+        + sizeof(int)
         + sizeof(std::uint64_t)
         + sizeof(std::unique_ptr<Netresult>);
 
     NNCache(int size = MAX_CACHE_COUNT);  // ~ 208MiB
+    ~NNCache();
 
     // Set a reasonable size gives max number of playouts
     void set_size_from_playouts(int max_playouts);
 
     // Resize NNCache
     void resize(int size);
+    // Clears the entries in memory, not those in an attached file.
     void clear();
 
+    // Look up and store results in file as well, behind memory.
+    // Attach before searching; the file is used outside the lock.
+    void attach_file(std::unique_ptr<NNCacheFile> file);
+
     // Try and find an existing entry.
     bool lookup(std::uint64_t hash, Netresult & result);
+    // Also return the symmetry the entry was inserted with.
+    bool lookup(std::uint64_t hash, Netresult & result, int & symmetry);
 
     // Insert a new entry.
     void insert(std::uint64_t hash,
-                const Netresult& result);
+                const Netresult& result,
+                const int symmetry = 0);
 
     // Return the hit rate ratio.
     std::pair<int, int> hit_rate() const {
@@ -94,19 +106,28 @@ public:
     size_t get_estimated_size();
 private:
 
+    void insert_locked(std::uint64_t hash,
+                       const Netresult& result,
+                       const int symmetry);
+
     std::mutex m_mutex;
 
+    std::unique_ptr<NNCacheFile> m_file;
+
     size_t m_size;
 
     // Statistics
     int m_hits{0};
     int m_lookups{0};
     int m_inserts{0};
+    int m_file_hits{0};
 
     struct Entry {
-        Entry(const Netresult& r)
-            : result(r) {}
+        Entry(const Netresult& r, const int sym)
+            : result(r), symmetry(sym) {}
         Netresult result;  // ~ 1.4KiB
+        // Symmetry that maps the stored position to the hashed one.
+        int symmetry;
     };
 
     // Map from hash to {features, result}
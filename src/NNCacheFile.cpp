@@ -0,0 +1,201 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include "config.h"
+#include "NNCacheFile.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace bip = boost::interprocess;
+
+static constexpr char CACHE_FILE_MAGIC[8] = {'L', 'Z', 'N', 'N', 'C', '0', '0', '2'};
+
+static_assert(std::is_trivially_copyable<NNCache::Netresult>::value,
+              "Netresult is copied to and from the mapped file");
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "Slots are shared with other processes");
+
+NNCacheFile::NNCacheFile(const std::string& filename, size_t entries,
+                         std::uint64_t network_hash, bool read_only)
+    : m_read_only(read_only) {
+    auto header = Header{};
+    auto valid = false;
+    auto path = filename;
+    {
+        auto in = std::ifstream{filename, std::ifstream::binary};
+        if (in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            const auto expected_size =
+                sizeof(Header) + header.slots * sizeof(Slot);
+            valid = !std::memcmp(header.magic, CACHE_FILE_MAGIC,
+                                 sizeof(header.magic))
+                && header.slot_size == sizeof(Slot)
+                && header.network_hash == network_hash
+                && header.slots > 0
+                && boost::filesystem::file_size(filename) == expected_size;
+        }
+    }
+
+    if (!valid || (!read_only && header.slots != entries)) {
+        if (read_only) {
+            throw std::runtime_error("not a cache file of this network");
+        }
+        if (entries == 0) {
+            throw std::runtime_error("no room for entries");
+        }
+        // Start over with an empty, sparse file of the requested size.
+        // It is built aside and renamed over the old one, which other
+        // processes may still have mapped.
+        path = filename + ".tmp";
+        {
+            auto out = std::ofstream{path,
+                std::ofstream::binary | std::ofstream::trunc};
+            if (!out) {
+                throw std::runtime_error("cannot create file");
+            }
+        }
+        boost::filesystem::resize_file(path,
+                                       sizeof(Header) + entries * sizeof(Slot));
+        std::memcpy(header.magic, CACHE_FILE_MAGIC, sizeof(header.magic));
+        header.slot_size = sizeof(Slot);
+        header.reserved = 0;
+        header.network_hash = network_hash;
+        header.slots = entries;
+        valid = false;
+    }
+
+    const auto mode = read_only ? bip::read_only : bip::read_write;
+    try {
+        auto mapping = bip::file_mapping{path.c_str(), mode};
+        m_region = std::make_unique<bip::mapped_region>(mapping, mode);
+    } catch (const bip::interprocess_exception& e) {
+        throw std::runtime_error(e.what());
+    }
+
+    auto base = static_cast<char*>(m_region->get_address());
+    if (!valid) {
+        std::memcpy(base, &header, sizeof(header));
+    }
+    if (path != filename
+        && std::rename(path.c_str(), filename.c_str()) != 0) {
+        std::remove(path.c_str());
+        throw std::runtime_error("cannot replace file");
+    }
+    m_slots = reinterpret_cast<Slot*>(base + sizeof(Header));
+    m_slot_count = header.slots;
+}
+
+NNCacheFile::~NNCacheFile() {
+    if (!m_read_only) {
+        m_region->flush();
+    }
+}
+
+bool NNCacheFile::lookup(std::uint64_t hash, Netresult& result,
+                         int& symmetry) const {
+    if (hash == EMPTY) {
+        return false;
+    }
+    for (auto i = 0; i < PROBES; i++) {
+        const auto& slot = m_slots[(hash + i) % m_slot_count];
+        const auto sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            continue;
+        }
+        const auto key = slot.key.load(std::memory_order_relaxed);
+        if (key == EMPTY) {
+            return false;
+        }
+        if (key != hash) {
+            continue;
+        }
+        std::memcpy(&result, &slot.result, sizeof(result));
+        symmetry = slot.symmetry;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // A writer may have taken the slot while we copied it.
+        return slot.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+    return false;
+}
+
+void NNCacheFile::insert(std::uint64_t hash, const Netresult& result,
+                         int symmetry) {
+    if (m_read_only || hash == EMPTY) {
+        return;
+    }
+    // The first free slot, or else replace the first one probed.
+    auto target = &m_slots[hash % m_slot_count];
+    for (auto i = 0; i < PROBES; i++) {
+        auto& slot = m_slots[(hash + i) % m_slot_count];
+        const auto key = slot.key.load(std::memory_order_relaxed);
+        if (key == hash) {
+            return;
+        }
+        if (key == EMPTY) {
+            target = &slot;
+            break;
+        }
+    }
+
+    // Leave the slot to a writer that got there first.
+    auto sequence = target->sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1)
+        || !target->sequence.compare_exchange_strong(
+               sequence, sequence + 1, std::memory_order_acquire)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    target->key.store(hash, std::memory_order_relaxed);
+    target->symmetry = symmetry;
+    std::memcpy(&target->result, &result, sizeof(result));
+    target->sequence.store(sequence + 2, std::memory_order_release);
+
+    if (++m_inserts % FLUSH_INTERVAL == 0) {
+        m_region->flush(0, 0, true);
+    }
+}
+
+size_t NNCacheFile::entries_for_bytes(size_t bytes) {
+    if (bytes < sizeof(Header)) {
+        return 0;
+    }
+    return (bytes - sizeof(Header)) / sizeof(Slot);
+}
+
+size_t NNCacheFile::get_entry_count() const {
+    return m_slot_count;
+}
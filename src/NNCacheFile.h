@@ -0,0 +1,108 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#ifndef NNCACHEFILE_H_INCLUDED
+#define NNCACHEFILE_H_INCLUDED
+
+#include "config.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "NNCache.h"
+
+namespace boost {
+namespace interprocess {
+class mapped_region;
+}
+}
+
+/*
+    Memory mapped hash table of network results that outlives the
+    process, so openings are not evaluated again after a restart.
+    Entries are keyed by position hash; the file as a whole belongs to
+    one network, identified by a hash stored in its header.
+
+    One process may write a file while any number of others map it
+    read only. Every slot has a sequence number that is odd while it
+    is written; readers only return an entry if it was even and
+    unchanged around their copy, so never one overwritten halfway.
+*/
+class NNCacheFile {
+public:
+    using Netresult = NNCache::Netresult;
+
+    // Slots probed for a position before giving up or replacing.
+    static constexpr auto PROBES = 4;
+    // Ask the OS to write back after this many inserts.
+    static constexpr auto FLUSH_INTERVAL = 10'000;
+
+    // Maps filename, creating or resetting it for network_hash with
+    // room for entries results unless it is opened read only. Throws
+    // std::runtime_error if the file cannot be used.
+    NNCacheFile(const std::string& filename, size_t entries,
+                std::uint64_t network_hash, bool read_only);
+    ~NNCacheFile();
+
+    // Results that fit in a file of the given size.
+    static size_t entries_for_bytes(size_t bytes);
+
+    bool lookup(std::uint64_t hash, Netresult& result, int& symmetry) const;
+    void insert(std::uint64_t hash, const Netresult& result, int symmetry);
+    size_t get_entry_count() const;
+
+private:
+    struct Header {
+        char magic[8];
+        std::uint32_t slot_size;
+        std::uint32_t reserved;
+        std::uint64_t network_hash;
+        std::uint64_t slots;
+    };
+    struct Slot {
+        // odd while being written
+        std::atomic<std::uint32_t> sequence;
+        std::int32_t symmetry;
+        // 0 while empty
+        std::atomic<std::uint64_t> key;
+        Netresult result;
+    };
+    static constexpr std::uint64_t EMPTY = 0;
+
+    std::unique_ptr<boost::interprocess::mapped_region> m_region;
+    Slot* m_slots{nullptr};
+    size_t m_slot_count{0};
+    bool m_read_only;
+    std::atomic<size_t> m_inserts{0};
+};
+
+#endif
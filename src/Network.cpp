@@ -33,6 +33,7 @@
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <fstream>
 #include <iterator>
 #include <memory>
 #include <sstream>
@@ -67,6 +68,7 @@
 #include "GameState.h"
 #include "GTP.h"
 #include "NNCache.h"
+#include "NNCacheFile.h"
 #include "Random.h"
 #include "ThreadPool.h"
 #include "Timing.h"
@@ -91,6 +93,33 @@ using ConstEigenMatrixMap =
 // Symmetry helper
 static std::array<std::array<int, NUM_INTERSECTIONS>,
                   Network::NUM_SYMMETRIES> symmetry_nn_idx_table;
+// Inverse of the above: symmetry_nn_idx_inverse[s][symmetry_nn_idx_table[s][v]] == v
+static std::array<std::array<int, NUM_INTERSECTIONS>,
+                  Network::NUM_SYMMETRIES> symmetry_nn_idx_inverse;
+
+// Positions are only looked up under their symmetries outside of
+// self-play, as it would reduce the randomness of the games.
+static bool symmetric_cache_lookups() {
+    return !cfg_noise && !cfg_random_cnt;
+}
+
+static bool canonical_cache_keys() {
+    return cfg_canonical_cache && symmetric_cache_lookups();
+}
+
+static std::uint64_t hash_file(const std::string& filename) {
+    // FNV-1a
+    auto hash = std::uint64_t{14695981039346656037ULL};
+    auto in = std::ifstream{filename, std::ifstream::binary};
+    char buffer[1 << 16];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+        for (auto i = std::streamsize{0}; i < in.gcount(); i++) {
+            hash ^= static_cast<unsigned char>(buffer[i]);
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
 
 float Network::benchmark_time(int centiseconds) {
     const auto cpus = cfg_num_threads;
@@ -499,6 +528,26 @@ void Network::initialize(int playouts, const std::string & weightsfile) {
     // explicitly set a maximum memory usage.
     m_nncache.set_size_from_playouts(playouts);
 
+    m_weightsfile = weightsfile;
+    if (!cfg_nncache_file.empty()) {
+        // Results under canonical keys must not mix with plain ones.
+        auto network_hash = get_weights_hash();
+        if (canonical_cache_keys()) {
+            network_hash ^= 0x9e3779b97f4a7c15ULL;
+        }
+        const auto entries =
+            NNCacheFile::entries_for_bytes(cfg_nncache_file_size);
+        try {
+            m_nncache.attach_file(std::make_unique<NNCacheFile>(
+                cfg_nncache_file, entries, network_hash,
+                cfg_nncache_file_readonly));
+            myprintf("Using NN cache file %s.\n", cfg_nncache_file.c_str());
+        } catch (const std::exception& e) {
+            myprintf("Not using NN cache file %s: %s.\n",
+                     cfg_nncache_file.c_str(), e.what());
+        }
+    }
+
     // Prepare symmetry table
     for (auto s = 0; s < NUM_SYMMETRIES; ++s) {
         for (auto v = 0; v < NUM_INTERSECTIONS; ++v) {
@@ -508,6 +557,7 @@ void Network::initialize(int playouts, const std::string & weightsfile) {
                 (newvtx.second * BOARD_SIZE) + newvtx.first;
             assert(symmetry_nn_idx_table[s][v] >= 0
                    && symmetry_nn_idx_table[s][v] < NUM_INTERSECTIONS);
+            symmetry_nn_idx_inverse[s][symmetry_nn_idx_table[s][v]] = v;
         }
     }
 
@@ -701,16 +751,53 @@ std::vector<float> softmax(const std::vector<float>& input,
     return output;
 }
 
+std::pair<std::uint64_t, int> Network::get_canonical_hash(
+    const GameState* const state) {
+    auto canonical = std::make_pair(state->get_symmetry_hash(IDENTITY_SYMMETRY),
+                                    int{IDENTITY_SYMMETRY});
+    for (auto sym = 0; sym < NUM_SYMMETRIES; ++sym) {
+        if (sym == IDENTITY_SYMMETRY) {
+            continue;
+        }
+        const auto hash = state->get_symmetry_hash(sym);
+        if (hash < canonical.first) {
+            canonical = std::make_pair(hash, sym);
+        }
+    }
+    return canonical;
+}
+
 bool Network::probe_cache(const GameState* const state,
                           Network::Netresult& result) {
+    if (canonical_cache_keys()) {
+        // Entries are stored under the hash of the canonical orientation,
+        // along with the symmetry that maps the stored position to it.
+        const auto canonical = get_canonical_hash(state);
+        auto stored_sym = int{IDENTITY_SYMMETRY};
+        if (!m_nncache.lookup(canonical.first, result, stored_sym)) {
+            return false;
+        }
+        if (stored_sym != canonical.second) {
+            decltype(result.policy) corrected_policy;
+            for (auto idx = size_t{0}; idx < NUM_INTERSECTIONS; ++idx) {
+                const auto canonical_idx =
+                    symmetry_nn_idx_table[canonical.second][idx];
+                const auto stored_idx =
+                    symmetry_nn_idx_inverse[stored_sym][canonical_idx];
+                corrected_policy[idx] = result.policy[stored_idx];
+            }
+            result.policy = std::move(corrected_policy);
+        }
+        return true;
+    }
+
     if (m_nncache.lookup(state->board.get_hash(), result)) {
         return true;
     }
     // If we are not generating a self-play game, try to find
-    // symmetries if we are in the early opening.
-    if (!cfg_noise && !cfg_random_cnt
-        && state->get_movenum()
-           < (state->get_timecontrol().opening_moves(BOARD_SIZE) / 2)) {
+    // symmetries. The symmetric hashes are maintained incrementally,
+    // so this is cheap enough to do for the whole game.
+    if (symmetric_cache_lookups()) {
         for (auto sym = 0; sym < Network::NUM_SYMMETRIES; ++sym) {
             if (sym == Network::IDENTITY_SYMMETRY) {
                 continue;
@@ -793,7 +880,12 @@ Network::Netresult Network::get_output(
 
     if (write_cache) {
         // Insert result into cache.
-        m_nncache.insert(state->board.get_hash(), result);
+        if (canonical_cache_keys()) {
+            const auto canonical = get_canonical_hash(state);
+            m_nncache.insert(canonical.first, result, canonical.second);
+        } else {
+            m_nncache.insert(state->board.get_hash(), result);
+        }
     }
 
     return result;
@@ -982,6 +1074,12 @@ std::pair<int, int> Network::get_symmetry(const std::pair<int, int>& vertex,
     return {x, y};
 }
 
+const std::array<int, NUM_INTERSECTIONS>& Network::get_symmetry_table(
+    const int symmetry) {
+    assert(symmetry >= 0 && symmetry < NUM_SYMMETRIES);
+    return symmetry_nn_idx_table[symmetry];
+}
+
 size_t Network::get_estimated_size() {
     if (estimated_size != 0) {
         return estimated_size;
@@ -1037,3 +1135,10 @@ void Network::nncache_resize(int max_count) {
 void Network::nncache_clear() {
     m_nncache.clear();
 }
+
+std::uint64_t Network::get_weights_hash() const {
+    std::call_once(m_weights_hash_once, [this] {
+        m_weights_hash = hash_file(m_weightsfile);
+    });
+    return m_weights_hash;
+}
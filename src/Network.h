@@ -35,6 +35,7 @@
 #include <deque>
 #include <array>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -100,11 +101,17 @@ public:
     static std::pair<int, int> get_symmetry(const std::pair<int, int>& vertex,
                                             const int symmetry,
                                             const int board_size = BOARD_SIZE);
+    // Input index idx under symmetry shows the point at table[idx].
+    // Filled in by initialize().
+    static const std::array<int, NUM_INTERSECTIONS>& get_symmetry_table(
+        const int symmetry);
 
     size_t get_estimated_size();
     size_t get_estimated_cache_size();
     void nncache_resize(int max_count);
     void nncache_clear();
+    // Identifies the weights file, for results kept outside the process.
+    std::uint64_t get_weights_hash() const;
 
 private:
     std::pair<int, int> load_v1_network(std::istream& wtfile);
@@ -136,6 +143,8 @@ private:
                                       std::vector<float>::iterator black,
                                       std::vector<float>::iterator white,
                                       const int symmetry);
+    static std::pair<std::uint64_t, int> get_canonical_hash(
+        const GameState* const state);
     bool probe_cache(const GameState* const state, Network::Netresult& result);
     std::unique_ptr<ForwardPipe>&& init_net(int channels,
                                             std::unique_ptr<ForwardPipe>&& pipe);
@@ -149,6 +158,10 @@ private:
 #endif
 
     NNCache m_nncache;
+    // Hashed on first use; reading the file again slows every startup.
+    std::string m_weightsfile;
+    mutable std::once_flag m_weights_hash_once;
+    mutable std::uint64_t m_weights_hash{0};
 
     size_t estimated_size{0};
 
@@ -29,36 +29,37 @@
 
 #include "SGFParser.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iterator>
 #include <stdexcept>
 #include <string>
+#include <sys/stat.h>
 
 #include "SGFTree.h"
 #include "Utils.h"
 
-std::vector<std::string> SGFParser::chop_stream(std::istream& ins,
-                                                size_t stopat) {
-    std::vector<std::string> result;
-    std::string gamebuff;
-
+bool SGFParser::chop_next(std::istream& ins, std::string& game) {
     ins >> std::noskipws;
 
     int nesting = 0;      // parentheses
     bool intag = false;   // brackets
     int line = 0;
-    gamebuff.clear();
+    game.clear();
 
     char c;
-    while (ins >> c && result.size() <= stopat) {
+    while (ins >> c) {
         if (c == '\n') line++;
 
-        gamebuff.push_back(c);
+        game.push_back(c);
         if (c == '\\') {
             // read literal char
             ins >> c;
-            gamebuff.push_back(c);
+            game.push_back(c);
             // Skip special char parsing
             continue;
         }
@@ -69,14 +70,14 @@ std::vector<std::string> SGFParser::chop_stream(std::istream& ins,
                 do {
                     ins >> c;
                 } while (std::isspace(c) && c != ';');
-                gamebuff.clear();
+                game.clear();
             }
             nesting++;
         } else if (c == ')' && !intag) {
             nesting--;
 
             if (nesting == 0) {
-                result.push_back(gamebuff);
+                return true;
             }
         } else if (c == '[' && !intag) {
             intag = true;
@@ -88,6 +89,18 @@ std::vector<std::string> SGFParser::chop_stream(std::istream& ins,
         }
     }
 
+    return false;
+}
+
+std::vector<std::string> SGFParser::chop_stream(std::istream& ins,
+                                                size_t stopat) {
+    std::vector<std::string> result;
+    std::string gamebuff;
+
+    while (result.size() <= stopat && chop_next(ins, gamebuff)) {
+        result.push_back(gamebuff);
+    }
+
     // No game found? Assume closing tag was missing (OGS)
     if (result.size() == 0) {
         result.push_back(gamebuff);
@@ -110,10 +123,153 @@ std::vector<std::string> SGFParser::chop_all(std::string filename,
     return result;
 }
 
-// scan the file and extract the game with number index
+std::vector<std::uint64_t> SGFParser::build_index(std::istream& ins) {
+    std::vector<std::uint64_t> offsets;
+    std::string gamebuff;
+
+    // chop_next skips anything before the opening parenthesis, so the
+    // end of the previous game is as good a start as any.
+    auto offset = std::uint64_t(ins.tellg());
+    while (chop_next(ins, gamebuff)) {
+        offsets.push_back(offset);
+        offset = std::uint64_t(ins.tellg());
+    }
+
+    return offsets;
+}
+
+namespace {
+
+/*
+    Sidecar index for multi-game SGF files, stored as <file>.idx:
+    magic, size and mtime of the SGF file it was built from, number of
+    games, then one 64-bit byte offset per game. Native byte order, it
+    is only a cache and gets rebuilt when anything doesn't match.
+*/
+constexpr char INDEX_MAGIC[8] = {'L', 'Z', 'S', 'G', 'F', 'I', 'D', 'X'};
+constexpr auto INDEX_HEADER_SIZE =
+    sizeof(INDEX_MAGIC) + 3 * sizeof(std::uint64_t);
+
+struct FileStamp {
+    std::uint64_t size;
+    std::uint64_t mtime;
+};
+
+bool get_file_stamp(const std::string& filename, FileStamp& stamp) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    stamp.size = std::uint64_t(st.st_size);
+    stamp.mtime = std::uint64_t(st.st_mtime);
+    return true;
+}
+
+template <typename T>
+bool read_raw(std::istream& ins, T& value) {
+    ins.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return bool(ins);
+}
+
+template <typename T>
+void write_raw(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Look up the offset of game index. Returns false if there is no
+// usable index, throws if the index is valid but the game isn't there.
+bool read_index_entry(const std::string& idx_filename, const FileStamp& stamp,
+                      size_t index, std::uint64_t& offset) {
+    std::ifstream ins(idx_filename, std::ifstream::binary);
+    if (ins.fail()) {
+        return false;
+    }
+
+    char magic[sizeof(INDEX_MAGIC)];
+    auto size = std::uint64_t{};
+    auto mtime = std::uint64_t{};
+    auto count = std::uint64_t{};
+    ins.read(magic, sizeof(magic));
+    if (!ins || !std::equal(magic, magic + sizeof(magic), INDEX_MAGIC)
+        || !read_raw(ins, size) || !read_raw(ins, mtime)
+        || !read_raw(ins, count)) {
+        return false;
+    }
+    if (size != stamp.size || mtime != stamp.mtime) {
+        return false;
+    }
+    if (index >= count) {
+        throw std::runtime_error("Game index out of range");
+    }
+
+    ins.seekg(INDEX_HEADER_SIZE + index * sizeof(std::uint64_t));
+    return read_raw(ins, offset);
+}
+
+void write_index(const std::string& idx_filename, const FileStamp& stamp,
+                 const std::vector<std::uint64_t>& offsets) {
+    // The SGF directory may well be read-only, so failing to write
+    // only means the next lookup has to scan the file again.
+    const auto tmp_filename = idx_filename + ".tmp";
+    {
+        std::ofstream out(tmp_filename, std::ofstream::binary);
+        if (out.fail()) {
+            return;
+        }
+        out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        write_raw(out, stamp.size);
+        write_raw(out, stamp.mtime);
+        write_raw(out, std::uint64_t(offsets.size()));
+        for (const auto offset : offsets) {
+            write_raw(out, offset);
+        }
+        if (out.fail()) {
+            out.close();
+            std::remove(tmp_filename.c_str());
+            return;
+        }
+    }
+    std::remove(idx_filename.c_str());
+    if (std::rename(tmp_filename.c_str(), idx_filename.c_str()) != 0) {
+        std::remove(tmp_filename.c_str());
+    }
+}
+
+}
+
+// extract the game with number index, using the sidecar index so
+// that only the first lookup in a big file has to scan all of it
 std::string SGFParser::chop_from_file(std::string filename, size_t index) {
-    auto vec = chop_all(filename, index);
-    return vec[index];
+    if (index == 0) {
+        // no need for an index, and keeps the missing tag fallback
+        auto vec = chop_all(filename, index);
+        return vec[index];
+    }
+
+    std::ifstream ins(filename.c_str(), std::ifstream::binary | std::ifstream::in);
+    auto stamp = FileStamp{};
+    if (ins.fail() || !get_file_stamp(filename, stamp)) {
+        throw std::runtime_error("Error opening file");
+    }
+
+    const auto idx_filename = filename + ".idx";
+    auto offset = std::uint64_t{};
+    if (!read_index_entry(idx_filename, stamp, index, offset)) {
+        const auto offsets = build_index(ins);
+        write_index(idx_filename, stamp, offsets);
+        if (index >= offsets.size()) {
+            throw std::runtime_error("Game index out of range");
+        }
+        offset = offsets[index];
+        ins.clear();
+    }
+
+    ins.seekg(offset);
+    std::string gamebuff;
+    if (!chop_next(ins, gamebuff)) {
+        throw std::runtime_error("Error reading game from file");
+    }
+    return gamebuff;
 }
 
 std::string SGFParser::parse_property_name(std::istringstream & strm) {
@@ -168,6 +324,100 @@ bool SGFParser::parse_property_value(std::istringstream & strm,
     return true;
 }
 
+namespace {
+
+/*
+    Range of characters in the buffer being parsed.
+*/
+struct SGFRange {
+    const char* begin;
+    const char* end;
+
+    bool operator==(const char* str) const {
+        const auto len = std::strlen(str);
+        return size_t(end - begin) == len && std::equal(begin, end, str);
+    }
+};
+
+/*
+    Properties that can matter for the main line: the ones SGFTree looks
+    at in the root, and moves, setup stones and side to move everywhere
+    else. Comments and markup are skipped without being copied.
+*/
+bool needed_property(const SGFRange& name, bool root) {
+    if (name == "B" || name == "W" || name == "AB" || name == "AW"
+        || name == "PL") {
+        return true;
+    }
+    return root;
+}
+
+}
+
+void SGFParser::parse_mainline(const char* begin, const char* end,
+                               SGFTree * node) {
+    const auto is_space = [](unsigned char pc) { return std::isspace(pc); };
+    const auto is_alpha = [](unsigned char pc) { return std::isalpha(pc); };
+    const auto* ptr = begin;
+    auto root = true;
+
+    while (ptr != end) {
+        const auto c = static_cast<unsigned char>(*ptr);
+
+        if (std::isspace(c)) {
+            ptr++;
+        } else if (std::isupper(c)) {
+            // property name, then any number of [values]
+            const auto name = SGFRange{ptr,
+                                       std::find_if_not(ptr, end, is_alpha)};
+            const auto keep = needed_property(name, root);
+            ptr = name.end;
+
+            for (;;) {
+                ptr = std::find_if_not(ptr, end, is_space);
+                if (ptr == end || *ptr != '[') {
+                    break;
+                }
+                ptr++;
+                auto value = std::string{};
+                while (ptr != end && *ptr != ']') {
+                    if (*ptr == '\\' && std::next(ptr) != end) {
+                        ptr++;
+                    }
+                    if (keep) {
+                        value.push_back(*ptr);
+                    }
+                    ptr++;
+                }
+                if (ptr != end) {
+                    ptr++;
+                }
+                if (keep) {
+                    node->add_property(std::string(name.begin, name.end),
+                                       std::move(value));
+                }
+            }
+        } else if (c == '(') {
+            // the first variation is the main line
+            ptr = std::find_if_not(std::next(ptr), end, is_space);
+            if (ptr != end && *ptr == ';') {
+                ptr++;
+            }
+            node = node->add_child();
+            root = false;
+        } else if (c == ';') {
+            ptr++;
+            node = node->add_child();
+            root = false;
+        } else if (c == ')') {
+            // main line ends, anything after is other variations
+            return;
+        } else {
+            ptr++;
+        }
+    }
+}
+
 void SGFParser::parse(std::istringstream & strm, SGFTree * node) {
     bool splitpoint = false;
 
@@ -44,12 +44,20 @@ private:
     static std::string parse_property_name(std::istringstream & strm);
     static bool parse_property_value(std::istringstream & strm, std::string & result);
 public:
+    // game number index, through a <fname>.idx sidecar index of
+    // game offsets that is rebuilt whenever fname changes
     static std::string chop_from_file(std::string fname, size_t index);
     static std::vector<std::string> chop_all(std::string fname,
                                              size_t stopat = SIZE_MAX);
     static std::vector<std::string> chop_stream(std::istream& ins,
                                                 size_t stopat = SIZE_MAX);
+    // read the next game from the stream, false if there is none left
+    static bool chop_next(std::istream& ins, std::string& game);
+    // byte offset of each game in the stream
+    static std::vector<std::uint64_t> build_index(std::istream& ins);
     static void parse(std::istringstream & strm, SGFTree * node);
+    static void parse_mainline(const char* begin, const char* end,
+                               SGFTree * node);
 };
 
 
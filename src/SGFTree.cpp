@@ -49,18 +49,74 @@
 using namespace Utils;
 
 const int SGFTree::EOT;
+const int SGFTree::DEFAULT_CHECKPOINT_INTERVAL;
 
 void SGFTree::init_state() {
     m_initialized = true;
     // Initialize with defaults.
     // The SGF might be missing boardsize or komi
     // which means we'll never initialize properly.
-    m_state.init_game(std::min(BOARD_SIZE, 19), KOMI);
+    m_state = std::make_unique<KoState>();
+    m_state->init_game(std::min(BOARD_SIZE, 19), KOMI);
 }
 
 const KoState * SGFTree::get_state(void) const {
     assert(m_initialized);
-    return &m_state;
+    if (!m_state) {
+        // Only nodes of lazy trees lack a state. Filling the cache
+        // doesn't change the tree, so allow it through const access.
+        const_cast<SGFTree*>(this)->replay_state();
+    }
+    return m_state.get();
+}
+
+void SGFTree::set_checkpoint_interval(int plies) {
+    m_checkpoint_interval = plies;
+}
+
+bool SGFTree::is_checkpoint() const {
+    return m_parent == nullptr
+        || (m_checkpoint_interval > 0 && m_ply % m_checkpoint_interval == 0);
+}
+
+// Compute the state of this node from the nearest ancestor that has
+// one, keeping the states of any checkpoints along the way.
+void SGFTree::replay_state() {
+    std::vector<SGFTree*> path;
+    auto node = this;
+    while (!node->m_state) {
+        path.push_back(node);
+        node = node->m_parent;
+        assert(node != nullptr);
+    }
+
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        auto child = *it;
+        if (node->is_checkpoint() || it == path.rbegin()) {
+            child->m_state = std::make_unique<KoState>(*node->m_state);
+        } else {
+            // intermediate state is not worth keeping
+            child->m_state = std::move(node->m_state);
+        }
+        child->m_timecontrol_ptr = node->m_timecontrol_ptr;
+
+        const auto colored_move = child->get_colored_move();
+        if (colored_move.first != FastBoard::INVAL) {
+            child->apply_move(colored_move.first, colored_move.second);
+        }
+        child->apply_properties();
+        node = child;
+    }
+}
+
+const FastBoard& SGFTree::get_geometry() const {
+    // every state in a tree has the same board size
+    auto node = this;
+    while (!node->m_state) {
+        node = node->m_parent;
+        assert(node != nullptr);
+    }
+    return node->m_state->board;
 }
 
 const SGFTree * SGFTree::get_child(size_t count) const {
@@ -120,6 +176,23 @@ void SGFTree::load_from_string(const std::string& gamebuff) {
     populate_states();
 }
 
+void SGFTree::populate_states() {
+    if (m_checkpoint_interval > 0) {
+        apply_properties();
+        link_children();
+    } else {
+        populate_all_states();
+    }
+}
+
+void SGFTree::load_mainline_from_string(const std::string& gamebuff) {
+    const auto* data = gamebuff.data();
+    SGFParser::parse_mainline(data, data + gamebuff.size(), this);
+
+    init_state();
+    populate_states();
+}
+
 // load a single game from a file
 void SGFTree::load_from_file(const std::string& filename, int index) {
     auto gamebuff = SGFParser::chop_from_file(filename, index);
@@ -129,7 +202,37 @@ void SGFTree::load_from_file(const std::string& filename, int index) {
     load_from_string(gamebuff);
 }
 
-void SGFTree::populate_states() {
+void SGFTree::link_children() {
+    for (auto& child : m_children) {
+        child.m_initialized = true;
+        child.m_parent = this;
+        child.m_ply = m_ply + 1;
+        child.m_checkpoint_interval = m_checkpoint_interval;
+        child.link_children();
+    }
+}
+
+void SGFTree::populate_all_states() {
+    apply_properties();
+
+    // now for all children play out the moves
+    for (auto& child_state : m_children) {
+        // propagate state
+        child_state.copy_state(*this);
+
+        // XXX: maybe move this to the recursive call
+        // get move for side to move
+        const auto colored_move = child_state.get_colored_move();
+        if (colored_move.first != FastBoard::INVAL) {
+            child_state.apply_move(colored_move.first, colored_move.second);
+        }
+
+        child_state.populate_all_states();
+    }
+}
+
+// set up this node's state from its own properties
+void SGFTree::apply_properties() {
     PropertyMap::iterator it;
     auto valid_size = false;
     auto has_handicap = false;
@@ -157,7 +260,7 @@ void SGFTree::populate_states() {
         strm >> bsize;
         if (bsize == BOARD_SIZE) {
             // Assume default komi in config.h if not specified
-            m_state.init_game(bsize, KOMI);
+            m_state->init_game(bsize, KOMI);
             valid_size = true;
         } else {
             throw std::runtime_error("Board size not supported.");
@@ -171,15 +274,15 @@ void SGFTree::populate_states() {
         std::istringstream strm(foo);
         float komi;
         strm >> komi;
-        const auto handicap = m_state.get_handicap();
+        const auto handicap = m_state->get_handicap();
         // last ditch effort: if no GM or SZ, assume 19x19 Go here
         auto bsize = 19;
         if (valid_size) {
-            bsize = m_state.board.get_boardsize();
+            bsize = m_state->board.get_boardsize();
         }
         if (bsize == BOARD_SIZE) {
-            m_state.init_game(bsize, komi);
-            m_state.set_handicap(handicap);
+            m_state->init_game(bsize, komi);
+            m_state->set_handicap(handicap);
         } else {
             throw std::runtime_error("Board size not supported.");
         }
@@ -214,7 +317,7 @@ void SGFTree::populate_states() {
         float handicap;
         strm >> handicap;
         has_handicap = (handicap > 0.0f);
-        m_state.set_handicap(int(handicap));
+        m_state->set_handicap(int(handicap));
     }
 
     // result
@@ -289,9 +392,9 @@ void SGFTree::populate_states() {
     // firstly.
     if (prop_ab_count > 0 || prop_aw_count > 0) {
         if (prop_ab_count < prop_aw_count)
-            m_state.set_to_move(FastBoard::BLACK);
+            m_state->set_to_move(FastBoard::BLACK);
         else
-            m_state.set_to_move(FastBoard::WHITE);
+            m_state->set_to_move(FastBoard::WHITE);
     }
 #endif
 
@@ -299,37 +402,22 @@ void SGFTree::populate_states() {
     if (it != end(m_properties)) {
         const auto who = it->second;
         if (who == "W") {
-            m_state.set_to_move(FastBoard::WHITE);
+            m_state->set_to_move(FastBoard::WHITE);
         } else if (who == "B") {
-            m_state.set_to_move(FastBoard::BLACK);
+            m_state->set_to_move(FastBoard::BLACK);
         }
     }
-
-    // now for all children play out the moves
-    for (auto& child_state : m_children) {
-        // propagate state
-        child_state.copy_state(*this);
-
-        // XXX: maybe move this to the recursive call
-        // get move for side to move
-        const auto colored_move = child_state.get_colored_move();
-        if (colored_move.first != FastBoard::INVAL) {
-            child_state.apply_move(colored_move.first, colored_move.second);
-        }
-
-        child_state.populate_states();
-    }
 }
 
 void SGFTree::copy_state(const SGFTree& tree) {
     m_initialized = tree.m_initialized;
-    m_state = tree.m_state;
+    m_state = std::make_unique<KoState>(*tree.m_state);
     m_timecontrol_ptr = tree.m_timecontrol_ptr;
 }
 
 void SGFTree::apply_move(int color, int move) {
     if (move != FastBoard::PASS && move != FastBoard::RESIGN) {
-        auto vtx_state = m_state.board.get_state(move);
+        auto vtx_state = m_state->board.get_state(move);
         if (vtx_state == !color || vtx_state == FastBoard::INVAL) {
             throw std::runtime_error("Illegal move");
         }
@@ -340,11 +428,11 @@ void SGFTree::apply_move(int color, int move) {
         }
         assert(vtx_state == FastBoard::EMPTY);
     }
-    m_state.play_move(color, move);
+    m_state->play_move(color, move);
 }
 
 void SGFTree::apply_move(int move) {
-    auto color = m_state.get_to_move();
+    auto color = m_state->get_to_move();
     apply_move(color, move);
 }
 
@@ -366,13 +454,14 @@ int SGFTree::string_to_vertex(const std::string& movestring) const {
         return FastBoard::PASS;
     }
 
-    if (m_state.board.get_boardsize() <= 19) {
+    const auto& board = get_geometry();
+    if (board.get_boardsize() <= 19) {
         if (movestring == "tt") {
             return FastBoard::PASS;
         }
     }
 
-    int bsize = m_state.board.get_boardsize();
+    int bsize = board.get_boardsize();
     if (bsize == 0) {
         throw std::runtime_error("Node has 0 sized board");
     }
@@ -400,7 +489,7 @@ int SGFTree::string_to_vertex(const std::string& movestring) const {
         throw std::runtime_error("Illegal SGF move");
     }
 
-    int vtx = m_state.board.get_vertex(cc1, cc2);
+    int vtx = board.get_vertex(cc1, cc2);
 
     return vtx;
 }
@@ -444,7 +533,7 @@ std::vector<int> SGFTree::get_mainline() const {
     std::vector<int> moves;
 
     const auto* link = this;
-    auto tomove = link->m_state.get_to_move();
+    auto tomove = link->get_state()->get_to_move();
     link = link->get_child(0);
 
     while (link != nullptr && link->is_initialized()) {
@@ -32,6 +32,7 @@
 
 #include <cstddef>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -44,9 +45,16 @@
 class SGFTree {
 public:
     static constexpr auto EOT = 0;               // End-Of-Tree marker
+    static constexpr auto DEFAULT_CHECKPOINT_INTERVAL = 16;
 
     SGFTree() = default;
     void init_state();
+    // Load lazily: nodes only keep their moves and properties, and
+    // get_state() replays from the nearest ancestor with a state.
+    // The state of every plies-th ply is kept as a checkpoint. Call
+    // before loading. A lazy tree caches states on access, so it must stay in
+    // place and can't be shared between threads.
+    void set_checkpoint_interval(int plies);
 
     const KoState * get_state() const;
     GameState follow_mainline_state(unsigned int movenum = 999) const;
@@ -54,6 +62,8 @@ public:
 
     void load_from_file(const std::string& filename, int index = 0);
     void load_from_string(const std::string& gamebuff);
+    // only the main line, skipping variations and comments
+    void load_mainline_from_string(const std::string& gamebuff);
 
     void add_property(std::string property, std::string value);
     SGFTree * add_child();
@@ -69,6 +79,12 @@ public:
 
 private:
     void populate_states();
+    void populate_all_states();
+    void apply_properties();
+    void link_children();
+    bool is_checkpoint() const;
+    void replay_state();
+    const FastBoard& get_geometry() const;
     void apply_move(int color, int move);
     void apply_move(int move);
     void copy_state(const SGFTree& state);
@@ -77,7 +93,11 @@ private:
     using PropertyMap = std::multimap<std::string, std::string>;
 
     bool m_initialized{false};
-    KoState m_state;
+    // null in nodes of lazy trees that haven't been needed yet
+    std::unique_ptr<KoState> m_state;
+    SGFTree* m_parent{nullptr};
+    int m_ply{0};
+    int m_checkpoint_interval{0};
     std::shared_ptr<TimeControl> m_timecontrol_ptr;
     FastBoard::vertex_t m_winner{FastBoard::INVAL};
     std::vector<SGFTree> m_children;
@@ -0,0 +1,203 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include "config.h"
+#include "SearchBook.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "FastBoard.h"
+#include "GTP.h"
+#include "GameState.h"
+#include "UCTNode.h"
+#include "Utils.h"
+
+using namespace Utils;
+
+SearchBook& SearchBook::get() {
+    static SearchBook s_book;
+    return s_book;
+}
+
+std::uint64_t SearchBook::key(const GameState& state) {
+    // The board hash covers the side to move and ko, but not komi.
+    // Komi goes in by its bits, std::hash differs between libraries.
+    const auto komi = state.get_komi();
+    auto komi_bits = std::uint32_t{};
+    static_assert(sizeof(komi_bits) == sizeof(komi), "komi is a float");
+    std::memcpy(&komi_bits, &komi, sizeof(komi_bits));
+    return state.board.get_hash() ^ (komi_bits * 0x9e3779b97f4a7c15ULL);
+}
+
+bool SearchBook::in_book(const GameState& state, int visits) {
+    return int(state.get_movenum()) < cfg_book_depth
+        && visits >= cfg_book_min_visits;
+}
+
+void SearchBook::load(const std::string& filename) {
+    auto in = std::ifstream{filename, std::ifstream::binary};
+    if (!in) {
+        throw std::runtime_error("Error opening file");
+    }
+    char magic[8];
+    if (!in.read(magic, sizeof(magic))
+        || std::memcmp(magic, MAGIC, sizeof(magic))) {
+        throw std::runtime_error("Not a book file");
+    }
+
+    auto entries = std::unordered_map<std::uint64_t, Entry>{};
+    const auto count = read_le(in, 8);
+    for (auto i = std::uint64_t{0}; i < count; i++) {
+        const auto hash = read_le(in, 8);
+        auto& entry = entries[hash];
+        entry.visits = std::int32_t(read_le(in, 4));
+        entry.eval = read_float_le(in);
+        entry.moves.resize(read_le(in, 2));
+        for (auto& move : entry.moves) {
+            move.move = std::int16_t(read_le(in, 2));
+            move.visits = std::int32_t(read_le(in, 4));
+            move.eval = read_float_le(in);
+            move.policy = read_float_le(in);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries = std::move(entries);
+}
+
+void SearchBook::save(const std::string& filename) const {
+    // Write under a temporary name and rename when done, so a crash or
+    // a second save never leaves a truncated book behind. The lock also
+    // keeps two saves from sharing the temporary file.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto tmp_filename = filename + ".tmp";
+    auto out = std::ofstream{tmp_filename, std::ofstream::binary};
+    if (!out) {
+        throw std::runtime_error("Error opening file");
+    }
+    out.write(MAGIC, std::strlen(MAGIC));
+
+    write_le(out, m_entries.size(), 8);
+    for (const auto& kv : m_entries) {
+        const auto& entry = kv.second;
+        write_le(out, kv.first, 8);
+        write_le(out, std::uint32_t(entry.visits), 4);
+        write_float_le(out, entry.eval);
+        write_le(out, entry.moves.size(), 2);
+        for (const auto& move : entry.moves) {
+            write_le(out, std::uint16_t(move.move), 2);
+            write_le(out, std::uint32_t(move.visits), 4);
+            write_float_le(out, move.eval);
+            write_float_le(out, move.policy);
+        }
+    }
+    out.close();
+    if (out.fail()) {
+        std::remove(tmp_filename.c_str());
+        throw std::runtime_error("Error writing file");
+    }
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        throw std::runtime_error("Error renaming " + tmp_filename);
+    }
+}
+
+bool SearchBook::lookup(const GameState& state, Entry& entry) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto iter = m_entries.find(key(state));
+    if (iter == m_entries.end() || !in_book(state, iter->second.visits)) {
+        return false;
+    }
+    entry = iter->second;
+    return true;
+}
+
+bool SearchBook::best_move(const GameState& state, bool allow_pass,
+                           Move& move) const {
+    auto entry = Entry{};
+    if (!lookup(state, entry)) {
+        return false;
+    }
+    const auto color = state.get_to_move();
+    auto found = false;
+    for (const auto& candidate : entry.moves) {
+        if (candidate.visits == 0
+            || (found && candidate.visits <= move.visits)
+            || (!allow_pass && candidate.move == FastBoard::PASS)) {
+            continue;
+        }
+        // The key is only a hash, make sure the move fits the board.
+        if (!state.is_move_legal(color, candidate.move)) {
+            return false;
+        }
+        move = candidate;
+        found = true;
+    }
+    return found;
+}
+
+void SearchBook::record(const GameState& state, const UCTNode& root) {
+    if (!in_book(state, root.get_visits())) {
+        return;
+    }
+    const auto color = state.get_to_move();
+    auto entry = Entry{};
+    entry.visits = root.get_visits();
+    entry.eval = root.get_eval(color);
+    for (const auto& child : root.get_children()) {
+        if (!child.valid()) {
+            continue;
+        }
+        auto move = Move{};
+        move.move = child.get_move();
+        move.visits = child.get_visits();
+        move.eval = move.visits > 0 ? child.get_eval(color) : 0.0f;
+        move.policy = child.get_policy();
+        entry.moves.emplace_back(move);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& stored = m_entries[key(state)];
+    if (stored.visits < entry.visits) {
+        stored = std::move(entry);
+    }
+}
+
+size_t SearchBook::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void SearchBook::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+}
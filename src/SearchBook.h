@@ -0,0 +1,96 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#ifndef SEARCHBOOK_H_INCLUDED
+#define SEARCHBOOK_H_INCLUDED
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class GameState;
+class UCTNode;
+
+/*
+    Results of long searches of opening positions, kept so later games
+    can play these moves without searching them again. Every entry has
+    the visits, evals and priors of the root children of one search;
+    a position searched more than once keeps the deepest search.
+*/
+class SearchBook {
+public:
+    static constexpr auto MAGIC = "LZBOOK02";
+
+    struct Move {
+        int move;
+        int visits;
+        // for the side to move, 0 without visits
+        float eval;
+        float policy;
+    };
+    struct Entry {
+        int visits;
+        float eval;
+        std::vector<Move> moves;
+    };
+
+    static SearchBook& get();
+
+    // Replaces the book with filename, throws std::runtime_error if it
+    // cannot be read.
+    void load(const std::string& filename);
+    void save(const std::string& filename) const;
+
+    // Entries of positions within cfg_book_depth moves that were
+    // searched with at least cfg_book_min_visits visits.
+    bool lookup(const GameState& state, Entry& entry) const;
+    // The most visited move of such an entry that may be played now.
+    bool best_move(const GameState& state, bool allow_pass,
+                   Move& move) const;
+    void record(const GameState& state, const UCTNode& root);
+
+    size_t size() const;
+    void clear();
+
+private:
+    SearchBook() = default;
+
+    static bool in_book(const GameState& state, int visits);
+    static std::uint64_t key(const GameState& state);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::uint64_t, Entry> m_entries;
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include "config.h"
+#include "SearchScheduler.h"
+
+#include <algorithm>
+#include <boost/format.hpp>
+
+SearchScheduler& SearchScheduler::get() {
+    static SearchScheduler s_scheduler;
+    return s_scheduler;
+}
+
+SearchScheduler::Client::Client() {
+    auto& scheduler = get();
+    std::lock_guard<std::mutex> lock(scheduler.m_mutex);
+    m_id = scheduler.m_next_id++;
+    scheduler.m_clients.push_back(this);
+}
+
+SearchScheduler::Client::~Client() {
+    auto& scheduler = get();
+    std::lock_guard<std::mutex> lock(scheduler.m_mutex);
+    auto& clients = scheduler.m_clients;
+    clients.erase(std::find(clients.begin(), clients.end(), this));
+}
+
+void SearchScheduler::Client::begin(priority_t priority) {
+    auto& scheduler = get();
+    std::lock_guard<std::mutex> lock(scheduler.m_mutex);
+    // Start level with the searches already running, so a new search
+    // neither owes them its idle time nor gets to catch up on it.
+    for (const auto client : scheduler.m_clients) {
+        if (client != this && client->m_active) {
+            m_vtime = std::max(m_vtime, client->m_vtime);
+        }
+    }
+    m_active = true;
+    m_priority = priority;
+    m_playouts = 0;
+    m_wait = 0;
+    m_start = clock::now();
+}
+
+void SearchScheduler::Client::end() {
+    auto& scheduler = get();
+    std::lock_guard<std::mutex> lock(scheduler.m_mutex);
+    m_active = false;
+    m_stop = clock::now();
+}
+
+double SearchScheduler::Client::playouts_per_second() const {
+    std::lock_guard<std::mutex> lock(get().m_mutex);
+    return playouts_per_second_locked();
+}
+
+double SearchScheduler::Client::mean_wait_ms() const {
+    std::lock_guard<std::mutex> lock(get().m_mutex);
+    return mean_wait_ms_locked();
+}
+
+double SearchScheduler::Client::playouts_per_second_locked() const {
+    const auto stop = m_active ? clock::now() : m_stop;
+    const auto seconds = std::chrono::duration<double>(stop - m_start).count();
+    return seconds > 0.0 ? m_playouts / seconds : 0.0;
+}
+
+double SearchScheduler::Client::mean_wait_ms_locked() const {
+    if (m_playouts == 0) {
+        return 0.0;
+    }
+    const auto wait = clock::duration{m_wait.load()};
+    return std::chrono::duration<double, std::milli>(wait).count()
+        / m_playouts;
+}
+
+SearchScheduler::Slot::Slot(Client& client)
+    : m_client(client), m_scheduled(get().acquire(m_client)) {}
+
+SearchScheduler::Slot::~Slot() {
+    if (m_scheduled) {
+        get().release();
+    }
+}
+
+void SearchScheduler::set_capacity(size_t slots) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = slots;
+    }
+    m_condvar.notify_all();
+}
+
+bool SearchScheduler::is_next(const Client& client) const {
+    for (const auto other : m_clients) {
+        if (other->m_waiting > 0 && other->m_vtime < client.m_vtime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SearchScheduler::acquire(Client& client) {
+    if (m_capacity.load(std::memory_order_relaxed) == 0) {
+        client.m_playouts.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const auto start = Client::clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_capacity == 0) {
+        client.m_playouts++;
+        return false;
+    }
+    client.m_waiting++;
+    m_condvar.wait(lock, [&] {
+        return m_capacity == 0
+            || (m_busy < m_capacity && is_next(client));
+    });
+    client.m_waiting--;
+    m_busy++;
+    client.m_vtime += 1.0 / (client.m_priority == INTERACTIVE ?
+                             INTERACTIVE_WEIGHT : BACKGROUND_WEIGHT);
+    client.m_playouts++;
+    client.m_wait += (Client::clock::now() - start).count();
+    return true;
+}
+
+void SearchScheduler::release() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_busy--;
+    }
+    m_condvar.notify_all();
+}
+
+std::string SearchScheduler::report() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto out = std::string{};
+    for (const auto client : m_clients) {
+        const auto state = !client->m_active ? "idle" :
+            client->m_priority == INTERACTIVE ? "interactive" : "background";
+        if (!out.empty()) {
+            out += "\n";
+        }
+        out += str(boost::format("search %d %s %.0f p/s %.2f ms wait")
+                   % client->m_id % state
+                   % client->playouts_per_second_locked()
+                   % client->mean_wait_ms_locked());
+    }
+    return out;
+}
@@ -0,0 +1,127 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#ifndef SEARCHSCHEDULER_H_INCLUDED
+#define SEARCHSCHEDULER_H_INCLUDED
+
+#include "config.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+    Divides evaluation capacity between searches that run at the same
+    time, as server sessions do. Every playout holds one of a limited
+    number of slots; free slots go to the waiting search that has
+    received the least weighted share so far, and searches for a move
+    weigh more than pondering and analysis. Without a capacity set,
+    slots are unlimited and only the statistics are kept, in atomics,
+    so ordinary play never takes the lock.
+*/
+class SearchScheduler {
+public:
+    enum priority_t {
+        INTERACTIVE, BACKGROUND
+    };
+    static constexpr auto INTERACTIVE_WEIGHT = 4.0;
+    static constexpr auto BACKGROUND_WEIGHT = 1.0;
+
+    // One per search, registered for its whole lifetime.
+    class Client {
+    public:
+        Client();
+        ~Client();
+        Client(const Client&) = delete;
+        Client& operator=(const Client&) = delete;
+
+        void begin(priority_t priority);
+        void end();
+        // of the running or else the last search
+        double playouts_per_second() const;
+        double mean_wait_ms() const;
+
+    private:
+        friend class SearchScheduler;
+        using clock = std::chrono::steady_clock;
+
+        double playouts_per_second_locked() const;
+        double mean_wait_ms_locked() const;
+
+        int m_id;
+        bool m_active{false};
+        priority_t m_priority{BACKGROUND};
+        double m_vtime{0.0};
+        int m_waiting{0};
+        std::atomic<std::uint64_t> m_playouts{0};
+        std::atomic<clock::rep> m_wait{0};
+        clock::time_point m_start{};
+        clock::time_point m_stop{};
+    };
+
+    // Holds a slot for one playout.
+    class Slot {
+    public:
+        explicit Slot(Client& client);
+        ~Slot();
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+    private:
+        Client& m_client;
+        bool m_scheduled;
+    };
+
+    static SearchScheduler& get();
+
+    // 0 for unlimited
+    void set_capacity(size_t slots);
+    // One line per search: id, state, playouts/s and queue wait.
+    std::string report() const;
+
+private:
+    SearchScheduler() = default;
+    // Returns whether a slot was taken, false when unlimited.
+    bool acquire(Client& client);
+    void release();
+    bool is_next(const Client& client) const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condvar;
+    std::vector<Client*> m_clients;
+    std::atomic<size_t> m_capacity{0};
+    size_t m_busy{0};
+    int m_next_id{1};
+};
+
+#endif
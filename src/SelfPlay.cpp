@@ -0,0 +1,140 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include "config.h"
+#include "SelfPlay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "FastBoard.h"
+#include "GTP.h"
+#include "GameState.h"
+#include "Network.h"
+#include "SGFTree.h"
+#include "ThreadPool.h"
+#include "Timing.h"
+#include "Training.h"
+#include "UCTSearch.h"
+#include "Utils.h"
+
+using namespace Utils;
+
+void SelfPlay::play_game(Network& network, float komi, size_t index,
+                         const std::string& prefix) {
+    Time start;
+    auto game = GameState{};
+    game.init_game(BOARD_SIZE, komi);
+    // training records are kept per thread, this thread is ours
+    Training::clear_training();
+    auto search = std::make_unique<UCTSearch>(game, network);
+
+    while (!game.has_resigned() && game.get_passes() < 2) {
+        const auto move = search->think(game.get_to_move());
+        game.play_move(move);
+    }
+
+    auto winner = int{FastBoard::EMPTY};
+    if (game.has_resigned()) {
+        winner = !game.who_resigned();
+    } else {
+        const auto score = game.final_score();
+        if (score > 0.0f) {
+            winner = FastBoard::BLACK;
+        } else if (score < 0.0f) {
+            winner = FastBoard::WHITE;
+        }
+    }
+
+    const auto basename = prefix + "_" + std::to_string(index);
+    // Training records only know won and lost, so a drawn game keeps
+    // its record but leaves no training data.
+    if (winner != FastBoard::EMPTY) {
+        Training::dump_training(winner, basename);
+    }
+    {
+        auto out = std::ofstream{basename + ".sgf"};
+        out << SGFTree::state_to_string(game, FastBoard::BLACK) << std::endl;
+    }
+    Training::clear_training();
+
+    Time end;
+    myprintf("Self-play game %d: %s after %d moves in %5.2f seconds\n",
+             int(index),
+             winner == FastBoard::BLACK ? "B+" :
+             winner == FastBoard::WHITE ? "W+" : "jigo, no training data",
+             int(game.get_movenum()),
+             Time::timediff_seconds(start, end));
+}
+
+void SelfPlay::run(Network& network, float komi, size_t num_games,
+                   size_t parallel, const std::string& prefix) {
+    parallel = std::max(std::min(parallel, num_games), size_t{1});
+    // every search runs on its player thread plus cfg_num_threads - 1
+    // pool threads, the pool was sized for one search
+    thread_pool.reserve(parallel * cfg_num_threads);
+
+    // The games share the tree memory. Give each its part explicitly,
+    // as server sessions get theirs, rather than what the others leave.
+    const auto session_memory = cfg_session_memory;
+    if (parallel > 1) {
+        const auto share = cfg_max_tree_size / parallel;
+        if (cfg_session_memory == 0 || cfg_session_memory > share) {
+            cfg_session_memory = share;
+        }
+        myprintf("%d games at a time, %d MiB of tree memory each.\n",
+                 int(parallel), int(cfg_session_memory / MiB));
+    }
+
+    std::atomic<size_t> next_game{0};
+    auto players = std::vector<std::thread>{};
+    for (auto i = size_t{0}; i < parallel; i++) {
+        players.emplace_back([&] {
+            for (;;) {
+                const auto index = next_game++;
+                if (index >= num_games) {
+                    return;
+                }
+                play_game(network, komi, index, prefix);
+            }
+        });
+    }
+    for (auto& player : players) {
+        player.join();
+    }
+
+    cfg_session_memory = session_memory;
+
+    // chunks are written in the background
+    OutputChunker::wait_for_writes();
+}
@@ -0,0 +1,60 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#ifndef SELFPLAY_H_INCLUDED
+#define SELFPLAY_H_INCLUDED
+
+#include "config.h"
+
+#include <cstddef>
+#include <string>
+
+class Network;
+
+/*
+    Self-play inside one engine: several games run at the same time,
+    each from its own thread with its own search, but all of them
+    evaluate positions with the same network, cache and (with OpenCL)
+    batch scheduler.
+*/
+class SelfPlay {
+public:
+    // Plays num_games games, parallel of them at a time, each with its
+    // share of the tree memory. Game N leaves its training data in
+    // prefix_N.0.gz and its record in prefix_N.sgf; drawn games have
+    // no training data.
+    static void run(Network& network, float komi, size_t num_games,
+                    size_t parallel, const std::string& prefix);
+
+private:
+    static void play_game(Network& network, float komi, size_t index,
+                          const std::string& prefix);
+};
+
+#endif
@@ -0,0 +1,161 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include "config.h"
+#include "Server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <istream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#include "GameState.h"
+#include "GTP.h"
+#include "SearchScheduler.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+
+using namespace Utils;
+using boost::asio::ip::tcp;
+
+namespace {
+
+class SocketChannel : public GTPChannel {
+public:
+    SocketChannel(tcp::socket& socket, const LineReader& reader)
+        : m_socket(socket), m_reader(reader) {}
+
+    void write(const std::string& text) override {
+        // A client that hung up is noticed by the reader.
+        auto error = boost::system::error_code{};
+        boost::asio::write(m_socket, boost::asio::buffer(text), error);
+    }
+
+    bool input_pending() override {
+        // Also true once the client hung up, which should stop
+        // pondering just the same.
+        return m_reader.pending();
+    }
+
+private:
+    tcp::socket& m_socket;
+    const LineReader& m_reader;
+};
+
+// Sessions beyond this many share pool threads; the scheduler lets
+// only cfg_num_threads playouts run at once anyway.
+constexpr auto MAX_POOLED_SESSIONS = size_t{4};
+
+std::atomic<size_t> s_sessions{0};
+
+void run_session(tcp::socket connection) {
+    // Every session searches on its own thread plus cfg_num_threads - 1
+    // pool threads, so the pool grows with the busiest moment, up to
+    // a bound: pool threads are never given back.
+    const auto sessions = std::min(++s_sessions, MAX_POOLED_SESSIONS);
+    thread_pool.reserve(sessions * cfg_num_threads);
+
+    // The reader thread can outlive this function, blocked in a read
+    // until the shutdown below, so it shares the socket.
+    auto socket = std::make_shared<tcp::socket>(std::move(connection));
+    auto input = std::make_shared<boost::asio::streambuf>();
+    LineReader reader([socket, input](std::string& line) {
+        auto error = boost::system::error_code{};
+        boost::asio::read_until(*socket, *input, '\n', error);
+        if (error) {
+            return false;
+        }
+        std::istream stream(input.get());
+        std::getline(stream, line);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        return true;
+    });
+    SocketChannel channel(*socket, reader);
+    set_gtp_channel(&channel);
+
+    // GTP::execute keeps one search per thread, bound to this board.
+    auto game = GameState{};
+    game.init_game(BOARD_SIZE, KOMI);
+
+    auto line = std::string{};
+    while (reader.get_line(line)) {
+        log_input(line);
+        // "quit" and "exit" end the session, not the whole process.
+        if (!GTP::execute(game, line)) {
+            break;
+        }
+    }
+
+    auto error = boost::system::error_code{};
+    socket->shutdown(tcp::socket::shutdown_both, error);
+    set_gtp_channel(nullptr);
+    --s_sessions;
+}
+
+}
+
+void Server::run(unsigned short port) {
+    boost::asio::io_service io_service;
+    tcp::acceptor acceptor(io_service);
+    try {
+        const auto endpoint =
+            tcp::endpoint{boost::asio::ip::address_v4::loopback(), port};
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(tcp::acceptor::reuse_address(true));
+        acceptor.bind(endpoint);
+        acceptor.listen();
+    } catch (const boost::system::system_error& e) {
+        printf("Could not listen on port %d: %s\n", port, e.what());
+        exit(EXIT_FAILURE);
+    }
+    myprintf("Serving GTP sessions on 127.0.0.1:%d.\n", port);
+
+    // Sessions together get the playouts one search would run, split
+    // by the scheduler so analysis cannot starve genmove.
+    SearchScheduler::get().set_capacity(cfg_num_threads);
+
+    for (;;) {
+        tcp::socket socket(io_service);
+        auto error = boost::system::error_code{};
+        acceptor.accept(socket, error);
+        if (error) {
+            continue;
+        }
+        std::thread(run_session, std::move(socket)).detach();
+    }
+}
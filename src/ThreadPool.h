@@ -49,6 +49,10 @@ public:
     // add an extra thread.  The thread calls initializer() before doing anything,
     // so that the user can initialize per-thread data structures before doing work.
     void add_thread(std::function<void()> initializer);
+
+    // grow the pool to at least this many threads, for callers that
+    // run several searches at the same time.
+    void reserve(std::size_t threads);
     template<class F, class... Args>
     auto add_task(F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
@@ -57,6 +61,7 @@ private:
     std::queue<std::function<void()>> m_tasks;
 
     std::mutex m_mutex;
+    std::mutex m_reserve_mutex;
     std::condition_variable m_condvar;
     bool m_exit{false};
 };
@@ -86,6 +91,13 @@ inline void ThreadPool::initialize(size_t threads) {
     }
 }
 
+inline void ThreadPool::reserve(size_t threads) {
+    std::lock_guard<std::mutex> lock(m_reserve_mutex);
+    while (m_threads.size() < threads) {
+        add_thread([](){} /* null function */);
+    }
+}
+
 template<class F, class... Args>
 auto ThreadPool::add_task(F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type> {
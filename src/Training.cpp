@@ -30,14 +30,22 @@
 #include "Training.h"
 
 #include <algorithm>
+#include <atomic>
 #include <bitset>
 #include <cassert>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <queue>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
 #include <utility>
 
 #include "FastBoard.h"
@@ -50,10 +58,17 @@
 #include "Timing.h"
 #include "UCTNode.h"
 #include "Utils.h"
-#include "string.h"
+#include "half/half.hpp"
 #include "zlib.h"
+#ifdef USE_ZSTD
+#include "zstd.h"
+#endif
 
-std::vector<TimeStep> Training::m_data{};
+thread_local std::vector<TimeStep> Training::m_data{};
+
+constexpr size_t TimeStep::INPUT_PLANES;
+constexpr size_t TrainingRecord::PLANE_BYTES;
+constexpr size_t TrainingRecord::BINARY_SIZE;
 
 std::ostream& operator <<(std::ostream& stream, const TimeStep& timestep) {
     stream << timestep.planes.size() << ' ';
@@ -73,19 +88,24 @@ std::ostream& operator <<(std::ostream& stream, const TimeStep& timestep) {
 }
 
 std::istream& operator>> (std::istream& stream, TimeStep& timestep) {
+    // Older files have the 2 side to move planes as well, skip them.
     int planes_size;
     stream >> planes_size;
     for (auto i = 0; i < planes_size; ++i) {
         TimeStep::BoardPlane plane;
         stream >> plane;
-        timestep.planes.push_back(plane);
+        if (size_t(i) < timestep.planes.size()) {
+            timestep.planes[i] = plane;
+        }
     }
     int prob_size;
     stream >> prob_size;
     for (auto i = 0; i < prob_size; ++i) {
         float prob;
         stream >> prob;
-        timestep.probabilities.push_back(prob);
+        if (size_t(i) < timestep.probabilities.size()) {
+            timestep.probabilities[i] = prob;
+        }
     }
     stream >> timestep.to_move;
     stream >> timestep.net_winrate;
@@ -95,55 +115,463 @@ std::istream& operator>> (std::istream& stream, TimeStep& timestep) {
     return stream;
 }
 
-std::string OutputChunker::gen_chunk_name() const {
-    auto base = std::string{m_basename};
-    base.append("." + std::to_string(m_chunk_count) + ".gz");
+static std::uint16_t float_to_half(const float value) {
+    return half_float::detail::float2half<std::round_to_nearest>(value);
+}
+
+static float half_to_float(const std::uint16_t bits) {
+    return half_float::detail::half2float<float>(bits);
+}
+
+void TrainingRecord::write_text(std::ostream& out) const {
+    // First output 16 times an input feature plane
+    for (const auto& plane : planes) {
+        // Write it out as a string of hex characters
+        for (auto bit = size_t{0}; bit + 3 < plane.size(); bit += 4) {
+            auto hexbyte =  plane[bit]     << 3
+                          | plane[bit + 1] << 2
+                          | plane[bit + 2] << 1
+                          | plane[bit + 3] << 0;
+            out << std::hex << hexbyte;
+        }
+        // NUM_INTERSECTIONS % 4 = 1 so the last bit goes by itself
+        // for odd sizes
+        assert(plane.size() % 4 == 1);
+        out << plane[plane.size() - 1];
+        out << std::dec << std::endl;
+    }
+    // The side to move planes can be compactly encoded into a single
+    // bit, 0 = black to move.
+    out << (to_move == FastBoard::BLACK ? "0" : "1") << std::endl;
+    // Then a POTENTIAL_MOVES long array of float probabilities
+    for (auto it = begin(probabilities); it != end(probabilities); ++it) {
+        out << *it;
+        if (std::next(it) != end(probabilities)) {
+            out << " ";
+        }
+    }
+    out << std::endl;
+    // And the game result for the side to move
+    out << (winner ? "1" : "-1") << std::endl;
+}
+
+bool TrainingRecord::read_text(std::istream& in) {
+    auto line = std::string{};
+    for (auto& plane : planes) {
+        if (!std::getline(in, line)
+            || line.size() != NUM_INTERSECTIONS / 4 + 1) {
+            return false;
+        }
+        for (auto i = size_t{0}; i + 1 < line.size(); i++) {
+            const auto c = std::tolower(line[i]);
+            auto nibble = 0;
+            if (c >= '0' && c <= '9') {
+                nibble = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                nibble = c - 'a' + 10;
+            } else {
+                return false;
+            }
+            for (auto bit = 0; bit < 4; bit++) {
+                plane[4 * i + bit] = (nibble >> (3 - bit)) & 1;
+            }
+        }
+        if (line.back() != '0' && line.back() != '1') {
+            return false;
+        }
+        plane[plane.size() - 1] = line.back() == '1';
+    }
+
+    if (!std::getline(in, line) || (line != "0" && line != "1")) {
+        return false;
+    }
+    to_move = line == "0" ? FastBoard::BLACK : FastBoard::WHITE;
+
+    if (!std::getline(in, line)) {
+        return false;
+    }
+    auto probstream = std::istringstream{line};
+    auto prob_count = size_t{0};
+    for (auto prob = 0.0f; probstream >> prob; prob_count++) {
+        if (prob_count < probabilities.size()) {
+            probabilities[prob_count] = prob;
+        }
+    }
+    if (prob_count != POTENTIAL_MOVES) {
+        return false;
+    }
+
+    if (!std::getline(in, line) || (line != "1" && line != "-1")) {
+        return false;
+    }
+    winner = line == "1";
+    return true;
+}
+
+std::vector<TrainingRecord> TrainingRecord::transform(
+    const std::vector<int>& symmetries) const {
+    static_assert(INPUT_PLANES <= 16, "planes must fit a 16-bit column");
+
+    // Bitsets can't be permuted wholesale, so collect the bits of all
+    // planes at each point once. Each orientation is then a single pass
+    // of table lookups that only has to set the bits that are on.
+    auto columns = std::array<std::uint16_t, NUM_INTERSECTIONS>{};
+    for (auto c = size_t{0}; c < INPUT_PLANES; c++) {
+        const auto& plane = planes[c];
+        for (auto idx = 0; idx < NUM_INTERSECTIONS; idx++) {
+            if (plane[idx]) {
+                columns[idx] |= std::uint16_t(1u << c);
+            }
+        }
+    }
+
+    auto result = std::vector<TrainingRecord>{};
+    result.reserve(symmetries.size());
+    for (const auto symmetry : symmetries) {
+        if (symmetry == Network::IDENTITY_SYMMETRY) {
+            result.emplace_back(*this);
+            continue;
+        }
+        const auto& table = Network::get_symmetry_table(symmetry);
+        auto record = TrainingRecord{};
+        record.to_move = to_move;
+        record.winner = winner;
+        for (auto idx = 0; idx < NUM_INTERSECTIONS; idx++) {
+            const auto src = table[idx];
+            record.probabilities[idx] = probabilities[src];
+            auto column = columns[src];
+            for (auto c = size_t{0}; column != 0; c++, column >>= 1) {
+                if (column & 1) {
+                    record.planes[c].set(idx);
+                }
+            }
+        }
+        record.probabilities[NUM_INTERSECTIONS] =
+            probabilities[NUM_INTERSECTIONS];
+        result.emplace_back(record);
+    }
+    return result;
+}
+
+void TrainingRecord::write_binary(std::string& out) const {
+    const auto start = out.size();
+    out.resize(start + BINARY_SIZE, '\0');
+    auto data = &out[start];
+
+    data[0] = BINARY_VERSION;
+    data += 4;
+
+    for (const auto prob : probabilities) {
+        const auto bits = float_to_half(prob);
+        data[0] = static_cast<char>(bits & 0xFF);
+        data[1] = static_cast<char>(bits >> 8);
+        data += 2;
+    }
+
+    for (auto p = size_t{0}; p < INPUT_PLANES; p++) {
+        for (auto idx = size_t{0}; idx < NUM_INTERSECTIONS; idx++) {
+            if (planes[p][idx]) {
+                const auto bit = p * NUM_INTERSECTIONS + idx;
+                data[bit / 8] |= 0x80 >> (bit % 8);
+            }
+        }
+    }
+    data += PLANE_BYTES;
+
+    data[0] = to_move == FastBoard::BLACK ? 0 : 1;
+    data[1] = winner ? 1 : 0;
+}
+
+void TrainingRecord::read_binary(const char* data) {
+    assert(data[0] == BINARY_VERSION);
+    data += 4;
+
+    for (auto& prob : probabilities) {
+        const auto bits = static_cast<std::uint16_t>(
+            std::uint8_t(data[0]) | std::uint8_t(data[1]) << 8);
+        prob = half_to_float(bits);
+        data += 2;
+    }
+
+    for (auto p = size_t{0}; p < INPUT_PLANES; p++) {
+        for (auto idx = size_t{0}; idx < NUM_INTERSECTIONS; idx++) {
+            const auto bit = p * NUM_INTERSECTIONS + idx;
+            planes[p][idx] = (data[bit / 8] >> (7 - bit % 8)) & 1;
+        }
+    }
+    data += PLANE_BYTES;
+
+    to_move = data[0] ? FastBoard::WHITE : FastBoard::BLACK;
+    winner = data[1] != 0;
+}
+
+static void write_chunk(const std::string& filename, const std::string& data,
+                        const chunk_codec_t codec, const int level) {
+    // Write under a temporary name and rename when done, so nobody
+    // picking up chunks ever sees a partial one.
+    const auto tmp_filename = filename + ".tmp";
+
+    if (codec == chunk_codec_t::GZIP) {
+        const auto mode = "wb" + std::to_string(std::min(std::max(level, 1), 9));
+        auto out = gzopen(tmp_filename.c_str(), mode.c_str());
+        if (!out) {
+            throw std::runtime_error("Error opening gzip output");
+        }
+        auto comp_size = gzwrite(out, data.data(), data.size());
+        gzclose(out);
+        if (!comp_size && !data.empty()) {
+            throw std::runtime_error("Error in gzip output");
+        }
+    } else {
+#ifdef USE_ZSTD
+        auto comp_buff = std::string(ZSTD_compressBound(data.size()), '\0');
+        auto comp_size = ZSTD_compress(&comp_buff[0], comp_buff.size(),
+                                       data.data(), data.size(), level);
+        if (ZSTD_isError(comp_size)) {
+            throw std::runtime_error(ZSTD_getErrorName(comp_size));
+        }
+        auto out = std::ofstream{tmp_filename, std::ofstream::binary};
+        out.write(comp_buff.data(), comp_size);
+        out.close();
+        if (out.fail()) {
+            throw std::runtime_error("Error in zstd output");
+        }
+#else
+        throw std::runtime_error("Not compiled with zstd support");
+#endif
+    }
+
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        throw std::runtime_error("Error renaming " + tmp_filename);
+    }
+}
+
+/*
+    Compresses and writes chunks on a background thread. Producers
+    only wait when MAX_PENDING chunks are already queued.
+*/
+class ChunkWriter {
+public:
+    static constexpr size_t MAX_PENDING = 8;
+
+    static ChunkWriter& get() {
+        static ChunkWriter s_writer;
+        return s_writer;
+    }
+
+    ~ChunkWriter() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_exit = true;
+        }
+        m_work.notify_all();
+        m_thread.join();
+    }
+
+    void write(const std::string& filename, std::string&& data,
+               const chunk_codec_t codec, const int level) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_queue.size() < MAX_PENDING; });
+        m_queue.emplace(Job{filename, std::move(data), codec, level});
+        m_work.notify_one();
+    }
+
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+    }
+
+private:
+    struct Job {
+        std::string filename;
+        std::string data;
+        chunk_codec_t codec;
+        int level;
+    };
+
+    ChunkWriter() : m_thread([this] { worker(); }) {}
+
+    void worker() {
+        for (;;) {
+            auto job = Job{};
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_work.wait(lock, [this] { return m_exit || !m_queue.empty(); });
+                if (m_queue.empty()) {
+                    return;
+                }
+                job = std::move(m_queue.front());
+                m_queue.pop();
+                m_busy = true;
+            }
+            m_done.notify_all();
+
+            try {
+                write_chunk(job.filename, job.data, job.codec, job.level);
+            } catch (const std::exception& e) {
+                Utils::myprintf("Error writing %s: %s\n",
+                                job.filename.c_str(), e.what());
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_busy = false;
+            }
+            m_done.notify_all();
+        }
+    }
+
+    std::queue<Job> m_queue;
+    bool m_busy{false};
+    bool m_exit{false};
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_done;
+    // last, so everything above exists when the thread starts
+    std::thread m_thread;
+};
+
+// 64-bit FNV-1a, stable across platforms and runs unlike std::hash
+static std::uint64_t fnv1a(const std::string& data,
+                           std::uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (const auto c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string OutputChunker::gen_chunk_name(const Output& output) const {
+    auto base = std::string{output.basename};
+    base.append("." + std::to_string(output.chunk_count));
+    base.append(m_codec == chunk_codec_t::ZSTD ? ".zst" : ".gz");
     return base;
 }
 
 OutputChunker::OutputChunker(const std::string& basename,
                              bool compress)
-    : m_basename(basename), m_compress(compress) {
+    : m_compress(compress),
+      m_codec(cfg_chunk_codec), m_level(cfg_chunk_level),
+      m_shuffle_size(cfg_shuffle_positions),
+      m_validation_split(cfg_validation_split),
+      m_rng(cfg_rng_seed ^ fnv1a(basename)) {
+    m_train.basename = basename;
+    m_validation.basename = basename + "_val";
 }
 
 OutputChunker::~OutputChunker() {
-    flush_chunks();
+    drain(m_train);
+    drain(m_validation);
+}
+
+void OutputChunker::wait_for_writes() {
+    ChunkWriter::get().wait_idle();
 }
 
 void OutputChunker::append(const std::string& str) {
-    m_buffer.append(str);
-    m_game_count++;
-    if (m_game_count >= CHUNK_SIZE) {
-        flush_chunks();
-    }
+    m_train.buffer.append(str);
+    end_game(m_train);
 }
 
-void OutputChunker::flush_chunks() {
-    if (m_compress) {
-        auto chunk_name = gen_chunk_name();
-        auto out = gzopen(chunk_name.c_str(), "wb9");
+std::uint64_t OutputChunker::game_key(
+    const std::vector<std::string>& positions) {
+    auto hash = std::uint64_t{0xcbf29ce484222325ULL};
+    for (const auto& position : positions) {
+        hash = fnv1a(position, hash);
+    }
+    return hash;
+}
 
-        auto in_buff_size = m_buffer.size();
-        auto in_buff = std::make_unique<char[]>(in_buff_size);
-        memcpy(in_buff.get(), m_buffer.data(), in_buff_size);
+void OutputChunker::append_game(const std::vector<std::string>& positions) {
+    append_game(positions, game_key(positions));
+}
 
-        auto comp_size = gzwrite(out, in_buff.get(), in_buff_size);
-        if (!comp_size) {
-            throw std::runtime_error("Error in gzip output");
+void OutputChunker::append_game(const std::vector<std::string>& positions,
+                                std::uint64_t game_key) {
+    auto& output = [&]() -> Output& {
+        if (m_validation_split <= 0.0f) {
+            return m_train;
         }
-        Utils::myprintf("Writing chunk %d\n",  m_chunk_count);
-        gzclose(out);
+        // top 24 bits as a fraction in [0, 1)
+        const auto fraction = float(game_key >> 40) / float(1 << 24);
+        return fraction < m_validation_split ? m_validation : m_train;
+    }();
+
+    for (const auto& position : positions) {
+        add_position(output, position);
+    }
+    end_game(output);
+}
+
+void OutputChunker::add_position(Output& output, const std::string& position) {
+    if (output.shuffle_buffer.size() < m_shuffle_size) {
+        output.shuffle_buffer.emplace_back(position);
+        return;
+    }
+    if (m_shuffle_size > 0) {
+        // reservoir style: a random held back position leaves instead
+        auto& held = output.shuffle_buffer[m_rng.randuint64(m_shuffle_size)];
+        output.buffer.append(held);
+        held = position;
     } else {
-        auto chunk_name = m_basename;
+        output.buffer.append(position);
+    }
+    output.position_count++;
+}
+
+void OutputChunker::end_game(Output& output) {
+    output.game_count++;
+    if (output.game_count >= CHUNK_SIZE) {
+        flush_chunks(output);
+    }
+}
+
+void OutputChunker::flush_chunks(Output& output) {
+    output.game_count = 0;
+    if (output.buffer.empty()) {
+        // still filling the shuffle buffer
+        return;
+    }
+
+    if (m_compress) {
+        Utils::myprintf("Writing chunk %d\n",  output.chunk_count);
+        ChunkWriter::get().write(gen_chunk_name(output),
+                                 std::move(output.buffer),
+                                 m_codec, m_level);
+    } else {
+        auto chunk_name = output.basename;
         auto flags = std::ofstream::out | std::ofstream::app;
         auto out = std::ofstream{chunk_name, flags};
-        out << m_buffer;
+        out << output.buffer;
         out.close();
     }
 
-    m_buffer.clear();
-    m_chunk_count++;
-    m_game_count = 0;
+    output.buffer.clear();
+    output.chunk_count++;
+}
+
+// Write out whatever is still held back, in chunks about as big as
+// the ones before.
+void OutputChunker::drain(Output& output) {
+    if (!output.shuffle_buffer.empty()) {
+        std::shuffle(begin(output.shuffle_buffer), end(output.shuffle_buffer),
+                     m_rng);
+        auto per_chunk = output.shuffle_buffer.size();
+        if (output.chunk_count > 0) {
+            per_chunk = std::max(output.position_count / output.chunk_count,
+                                 size_t{1});
+        }
+        auto in_chunk = size_t{0};
+        for (const auto& position : output.shuffle_buffer) {
+            output.buffer.append(position);
+            if (++in_chunk == per_chunk) {
+                flush_chunks(output);
+                in_chunk = 0;
+            }
+        }
+        output.shuffle_buffer.clear();
+    }
+    flush_chunks(output);
 }
 
 void Training::clear_training() {
@@ -154,9 +582,8 @@ TimeStep::NNPlanes Training::get_planes(const GameState* const state) {
     const auto input_data = Network::gather_features(state, 0);
 
     auto planes = TimeStep::NNPlanes{};
-    planes.resize(Network::INPUT_CHANNELS);
 
-    for (auto c = size_t{0}; c < Network::INPUT_CHANNELS; c++) {
+    for (auto c = size_t{0}; c < TimeStep::INPUT_PLANES; c++) {
         for (auto idx = 0; idx < NUM_INTERSECTIONS; idx++) {
             planes[c][idx] = bool(input_data[c * NUM_INTERSECTIONS + idx]);
         }
@@ -178,8 +605,6 @@ void Training::record(Network & network, GameState& state, UCTNode& root) {
     step.child_uct_winrate = best_node.get_eval(step.to_move);
     step.bestmove_visits = best_node.get_visits();
 
-    step.probabilities.resize(POTENTIAL_MOVES);
-
     // Get total visit amount. We count rather
     // than trust the root to avoid ttable issues.
     auto sum_visits = 0.0;
@@ -243,48 +668,142 @@ void Training::load_training(std::ifstream& in) {
 }
 
 void Training::dump_training(int winner_color, OutputChunker& outchunk) {
-    auto training_str = std::string{};
-    for (const auto& step : m_data) {
+    dump_training(winner_color, m_data, outchunk);
+}
+
+void Training::dump_training(int winner_color,
+                             const std::vector<TimeStep>& data,
+                             OutputChunker& outchunk) {
+    auto symmetries = std::vector<int>{Network::IDENTITY_SYMMETRY};
+    if (cfg_training_symmetries == training_symmetry_t::ALL) {
+        symmetries.resize(Network::NUM_SYMMETRIES);
+        std::iota(begin(symmetries), end(symmetries), 0);
+    }
+
+    const auto serialize = [](const TrainingRecord& record) {
+        if (cfg_binary_training) {
+            auto out = std::string{};
+            record.write_binary(out);
+            return out;
+        }
         auto out = std::stringstream{};
-        // First output 16 times an input feature plane
-        for (auto p = size_t{0}; p < 16; p++) {
-            const auto& plane = step.planes[p];
-            // Write it out as a string of hex characters
-            for (auto bit = size_t{0}; bit + 3 < plane.size(); bit += 4) {
-                auto hexbyte =  plane[bit]     << 3
-                              | plane[bit + 1] << 2
-                              | plane[bit + 2] << 1
-                              | plane[bit + 3] << 0;
-                out << std::hex << hexbyte;
+        record.write_text(out);
+        return out.str();
+    };
+
+    auto records = std::vector<TrainingRecord>{};
+    auto plain = std::vector<std::string>{};
+    records.reserve(data.size());
+    plain.reserve(data.size());
+    for (const auto& step : data) {
+        auto record = TrainingRecord{};
+        record.planes = step.planes;
+        record.probabilities = step.probabilities;
+        record.to_move = step.to_move;
+        record.winner = (step.to_move == winner_color);
+        plain.emplace_back(serialize(record));
+        records.emplace_back(record);
+    }
+
+    // The split and the random orientations follow from the game as
+    // played, so it ends up on the same side on every run.
+    const auto game_key = OutputChunker::game_key(plain);
+    if (cfg_training_symmetries == training_symmetry_t::NONE) {
+        outchunk.append_game(plain, game_key);
+        return;
+    }
+
+    auto rng = Random{game_key};
+    auto positions = std::vector<std::string>{};
+    positions.reserve(data.size() * symmetries.size());
+    for (auto i = size_t{0}; i < records.size(); i++) {
+        if (cfg_training_symmetries == training_symmetry_t::RANDOM) {
+            symmetries[0] = rng.randfix<Network::NUM_SYMMETRIES>();
+        }
+        const auto oriented = records[i].transform(symmetries);
+        for (auto j = size_t{0}; j < oriented.size(); j++) {
+            if (symmetries[j] == Network::IDENTITY_SYMMETRY) {
+                positions.emplace_back(plain[i]);
+            } else {
+                positions.emplace_back(serialize(oriented[j]));
             }
-            // NUM_INTERSECTIONS % 4 = 1 so the last bit goes by itself
-            // for odd sizes
-            assert(plane.size() % 4 == 1);
-            out << plane[plane.size() - 1];
-            out << std::dec << std::endl;
-        }
-        // The side to move planes can be compactly encoded into a single
-        // bit, 0 = black to move.
-        out << (step.to_move == FastBoard::BLACK ? "0" : "1") << std::endl;
-        // Then a POTENTIAL_MOVES long array of float probabilities
-        for (auto it = begin(step.probabilities);
-            it != end(step.probabilities); ++it) {
-            out << *it;
-            if (next(it) != end(step.probabilities)) {
-                out << " ";
+        }
+    }
+    outchunk.append_game(positions, game_key);
+}
+
+std::vector<TrainingRecord> Training::read_chunk(const std::string& filename) {
+    // gzread passes uncompressed files through unchanged
+    auto in = gzopen(filename.c_str(), "rb");
+    if (!in) {
+        throw std::runtime_error("Cannot open " + filename);
+    }
+    auto data = std::string{};
+    auto buffer = std::vector<char>(1 << 16);
+    auto bytes = 0;
+    while ((bytes = gzread(in, buffer.data(), buffer.size())) > 0) {
+        data.append(buffer.data(), bytes);
+    }
+    gzclose(in);
+    if (bytes < 0) {
+        throw std::runtime_error("Error reading " + filename);
+    }
+
+    const auto zstd_magic = std::string{"\x28\xB5\x2F\xFD"};
+    if (data.compare(0, 4, zstd_magic) == 0) {
+#ifdef USE_ZSTD
+        const auto size = ZSTD_getFrameContentSize(data.data(), data.size());
+        if (size == ZSTD_CONTENTSIZE_ERROR
+            || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+            throw std::runtime_error("Bad zstd chunk " + filename);
+        }
+        auto decompressed = std::string(size, '\0');
+        const auto result = ZSTD_decompress(&decompressed[0], size,
+                                            data.data(), data.size());
+        if (ZSTD_isError(result)) {
+            throw std::runtime_error(ZSTD_getErrorName(result));
+        }
+        data = std::move(decompressed);
+#else
+        throw std::runtime_error("Not compiled with zstd support");
+#endif
+    }
+
+    auto records = std::vector<TrainingRecord>{};
+    auto record = TrainingRecord{};
+    const auto binary_version =
+        std::string{char(TrainingRecord::BINARY_VERSION), 0, 0, 0};
+    if (data.compare(0, 4, binary_version) == 0) {
+        if (data.size() % TrainingRecord::BINARY_SIZE != 0) {
+            throw std::runtime_error("Truncated training chunk " + filename);
+        }
+        for (auto pos = size_t{0}; pos < data.size();
+             pos += TrainingRecord::BINARY_SIZE) {
+            if (data.compare(pos, 4, binary_version) != 0) {
+                throw std::runtime_error("Bad record in " + filename);
             }
+            record.read_binary(data.data() + pos);
+            records.push_back(record);
         }
-        out << std::endl;
-        // And the game result for the side to move
-        if (step.to_move == winner_color) {
-            out << "1";
-        } else {
-            out << "-1";
+    } else {
+        auto stream = std::istringstream{data};
+        while (record.read_text(stream)) {
+            records.push_back(record);
+        }
+        if (!stream.eof()) {
+            throw std::runtime_error("Bad record in " + filename);
         }
-        out << std::endl;
-        training_str.append(out.str());
     }
-    outchunk.append(training_str);
+    return records;
+}
+
+void Training::convert_chunk(const std::string& in_filename,
+                             const std::string& out_filename) {
+    auto data = std::string{};
+    for (const auto& record : read_chunk(in_filename)) {
+        record.write_binary(data);
+    }
+    write_chunk(out_filename, data, cfg_chunk_codec, cfg_chunk_level);
 }
 
 void Training::dump_debug(const std::string& filename) {
@@ -314,7 +833,7 @@ void Training::dump_debug(OutputChunker& outchunk) {
 void Training::process_game(GameState& state, size_t& train_pos, int who_won,
                             const std::vector<int>& tree_moves,
                             OutputChunker& outchunker) {
-    clear_training();
+    auto data = std::vector<TimeStep>{};
     auto counter = size_t{0};
     state.rewind();
 
@@ -342,16 +861,48 @@ void Training::process_game(GameState& state, size_t& train_pos, int who_won,
         step.to_move = to_move;
         step.planes = get_planes(&state);
 
-        step.probabilities.resize(POTENTIAL_MOVES);
         step.probabilities[move_idx] = 1.0f;
 
         train_pos++;
-        m_data.emplace_back(step);
+        data.emplace_back(step);
 
         counter++;
     } while (state.forward_move() && counter < tree_moves.size());
 
-    dump_training(who_won, outchunker);
+    dump_training(who_won, data, outchunker);
+}
+
+size_t Training::process_sgf(const std::string& sgf,
+                             OutputChunker& outchunker) {
+    auto train_pos = size_t{0};
+    auto sgftree = std::make_unique<SGFTree>();
+    try {
+        sgftree->load_mainline_from_string(sgf);
+    } catch (...) {
+        return train_pos;
+    };
+
+    auto tree_moves = sgftree->get_mainline();
+    // Empty game or couldn't be parsed?
+    if (tree_moves.size() == 0) {
+        return train_pos;
+    }
+
+    auto who_won = sgftree->get_winner();
+    // Accept all komis and handicaps, but reject no usable result
+    if (who_won != FastBoard::BLACK && who_won != FastBoard::WHITE) {
+        return train_pos;
+    }
+
+    auto state =
+        std::make_unique<GameState>(sgftree->follow_mainline_state());
+    // Our board size is hardcoded in several places
+    if (state->board.get_boardsize() != BOARD_SIZE) {
+        return train_pos;
+    }
+
+    process_game(*state, train_pos, who_won, tree_moves, outchunker);
+    return train_pos;
 }
 
 void Training::dump_supervised(const std::string& sgf_name,
@@ -369,13 +920,6 @@ void Training::dump_supervised(const std::string& sgf_name,
 
     Time start;
     for (auto gamecount = size_t{0}; gamecount < gametotal; gamecount++) {
-        auto sgftree = std::make_unique<SGFTree>();
-        try {
-            sgftree->load_from_string(games[gamecount]);
-        } catch (...) {
-            continue;
-        };
-
         if (gamecount > 0 && gamecount % 1000 == 0) {
             Time elapsed;
             auto elapsed_s = Time::timediff_seconds(start, elapsed);
@@ -384,28 +928,125 @@ void Training::dump_supervised(const std::string& sgf_name,
                 gamecount, train_pos, elapsed_s, int(train_pos / elapsed_s));
         }
 
-        auto tree_moves = sgftree->get_mainline();
-        // Empty game or couldn't be parsed?
-        if (tree_moves.size() == 0) {
-            continue;
-        }
+        train_pos += process_sgf(games[gamecount], outchunker);
+    }
 
-        auto who_won = sgftree->get_winner();
-        // Accept all komis and handicaps, but reject no usable result
-        if (who_won != FastBoard::BLACK && who_won != FastBoard::WHITE) {
-            continue;
+    std::cout << "Dumped " << train_pos << " training positions." << std::endl;
+}
+
+/*
+    Bounded queue handing games from the reader to the workers.
+*/
+class SGFQueue {
+public:
+    explicit SGFQueue(size_t capacity) : m_capacity(capacity) {}
+
+    void push(std::string&& game) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this] { return m_games.size() < m_capacity; });
+        m_games.emplace(std::move(game));
+        m_not_empty.notify_one();
+    }
+
+    // false once the queue is closed and drained
+    bool pop(std::string& game) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return m_closed || !m_games.empty(); });
+        if (m_games.empty()) {
+            return false;
         }
+        game = std::move(m_games.front());
+        m_games.pop();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_empty.notify_all();
+    }
+
+private:
+    std::queue<std::string> m_games;
+    size_t m_capacity;
+    bool m_closed{false};
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+};
+
+void Training::dump_supervised(const std::string& sgf_name,
+                               const std::string& out_filename,
+                               size_t num_threads) {
+    auto ins = std::ifstream{sgf_name, std::ifstream::binary | std::ifstream::in};
+    if (ins.fail()) {
+        throw std::runtime_error("Error opening file");
+    }
 
-        auto state =
-            std::make_unique<GameState>(sgftree->follow_mainline_state());
-        // Our board size is hardcoded in several places
-        if (state->board.get_boardsize() != BOARD_SIZE) {
+    num_threads = std::max(num_threads, size_t{1});
+    SGFQueue queue(4 * num_threads);
+    std::atomic<size_t> train_pos{0};
+    auto worker_pos = std::vector<size_t>(num_threads);
+    auto worker_secs = std::vector<double>(num_threads);
+
+    // Every worker writes its own chunks, out_filename_N.M.gz
+    auto workers = std::vector<std::thread>{};
+    for (auto i = size_t{0}; i < num_threads; i++) {
+        workers.emplace_back([&, i] {
+            auto outchunker = OutputChunker{
+                out_filename + "_" + std::to_string(i), true};
+            Time start;
+            auto game = std::string{};
+            while (queue.pop(game)) {
+                auto positions = process_sgf(game, outchunker);
+                worker_pos[i] += positions;
+                train_pos += positions;
+            }
+            worker_secs[i] = Time::timediff_seconds(start, Time{});
+        });
+    }
+
+    // Shuffle through a bounded reservoir: every game read replaces a
+    // random held back game, which goes to the workers instead.
+    auto reservoir = std::vector<std::string>{};
+    auto& rng = Random::get_Rng();
+    auto gamecount = size_t{0};
+    auto game = std::string{};
+    Time start;
+    while (SGFParser::chop_next(ins, game)) {
+        gamecount++;
+        if (gamecount % 1000 == 0) {
+            Time elapsed;
+            auto elapsed_s = Time::timediff_seconds(start, elapsed);
+            Utils::myprintf(
+                "Read %5d games, %5d positions in %5.2f seconds -> %d pos/s\n",
+                gamecount, int(train_pos), elapsed_s,
+                int(train_pos / elapsed_s));
+        }
+        if (reservoir.size() < SUPERVISED_SHUFFLE_GAMES) {
+            reservoir.emplace_back(std::move(game));
             continue;
         }
+        auto pick = rng.randuint64(reservoir.size());
+        std::swap(reservoir[pick], game);
+        queue.push(std::move(game));
+    }
+    std::shuffle(begin(reservoir), end(reservoir), rng);
+    for (auto& held : reservoir) {
+        queue.push(std::move(held));
+    }
+    queue.close();
 
-        process_game(*state, train_pos, who_won, tree_moves,
-                    outchunker);
+    for (auto& worker : workers) {
+        worker.join();
     }
 
-    std::cout << "Dumped " << train_pos << " training positions." << std::endl;
+    std::cout << "Total games in file: " << gamecount << std::endl;
+    for (auto i = size_t{0}; i < num_threads; i++) {
+        Utils::myprintf("Thread %d: %d positions in %5.2f seconds -> %d pos/s\n",
+                        int(i), int(worker_pos[i]), worker_secs[i],
+                        int(worker_pos[i] / std::max(worker_secs[i], 0.001)));
+    }
+    std::cout << "Dumped " << train_pos.load() << " training positions." << std::endl;
 }
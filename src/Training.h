@@ -32,22 +32,33 @@
 
 #include "config.h"
 
+#include <array>
 #include <bitset>
 #include <cstddef>
+#include <iosfwd>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "GTP.h"
 #include "GameState.h"
 #include "Network.h"
+#include "Random.h"
 #include "UCTNode.h"
 
+/*
+    Fixed size, so a game's worth of them is one allocation. Only the
+    16 history planes are kept, the side to move planes follow from
+    to_move.
+*/
 class TimeStep {
 public:
+    static constexpr size_t INPUT_PLANES = 16;
     using BoardPlane = std::bitset<NUM_INTERSECTIONS>;
-    using NNPlanes = std::vector<BoardPlane>;
+    using NNPlanes = std::array<BoardPlane, INPUT_PLANES>;
+    using Probabilities = std::array<float, POTENTIAL_MOVES>;
     NNPlanes planes;
-    std::vector<float> probabilities;
+    Probabilities probabilities;
     int to_move;
     float net_winrate;
     float root_uct_winrate;
@@ -58,22 +69,93 @@ public:
 std::ostream& operator<< (std::ostream& stream, const TimeStep& timestep);
 std::istream& operator>> (std::istream& stream, TimeStep& timestep);
 
+/*
+    One position of a training chunk.
+
+    Version 1 chunks store it as 19 lines of text. Version 3 chunks
+    are a sequence of fixed size little endian binary records:
+        int32   version (3)
+        uint16  POTENTIAL_MOVES probabilities, IEEE fp16
+        uint8   16 * NUM_INTERSECTIONS plane bits, MSB first
+        uint8   side to move, 0 = black
+        uint8   1 if the side to move won, otherwise 0
+    (version 2 is the float32 variant used inside training/tf)
+*/
+class TrainingRecord {
+public:
+    static constexpr int TEXT_VERSION = 1;
+    static constexpr int BINARY_VERSION = 3;
+    static constexpr size_t INPUT_PLANES = TimeStep::INPUT_PLANES;
+    static constexpr size_t PLANE_BYTES =
+        (INPUT_PLANES * NUM_INTERSECTIONS + 7) / 8;
+    static constexpr size_t BINARY_SIZE =
+        4 + 2 * POTENTIAL_MOVES + PLANE_BYTES + 2;
+
+    TimeStep::NNPlanes planes;
+    TimeStep::Probabilities probabilities;
+    int to_move;
+    bool winner;
+
+    void write_text(std::ostream& out) const;
+    void write_binary(std::string& out) const;
+    // this position under each of symmetries, for augmentation
+    std::vector<TrainingRecord> transform(
+        const std::vector<int>& symmetries) const;
+    bool read_text(std::istream& in);
+    void read_binary(const char* data);
+};
+
+/*
+    Groups training data into chunks. Each game goes either to the
+    training chunks or to the validation chunks (<basename>_val),
+    decided by a hash of its data, so the split is the same on every
+    run. With a shuffle buffer, positions are held back and leave it in
+    random order, so the positions of one game are spread over many
+    chunks.
+*/
 class OutputChunker {
 public:
     OutputChunker(const std::string& basename, bool compress = false);
     ~OutputChunker();
+    // raw data, not split or shuffled
     void append(const std::string& str);
+    // one game, one string per position
+    void append_game(const std::vector<std::string>& positions);
+    // The split follows game_key instead, for games whose positions
+    // are written in an orientation that varies between runs.
+    void append_game(const std::vector<std::string>& positions,
+                     std::uint64_t game_key);
+    static std::uint64_t game_key(const std::vector<std::string>& positions);
+
+    // Chunks are compressed and written in the background,
+    // this waits until all of them are on disk.
+    static void wait_for_writes();
 
     // Group this many games in a batch.
     static constexpr size_t CHUNK_SIZE = 32;
 private:
-    std::string gen_chunk_name() const;
-    void flush_chunks();
-    size_t m_game_count{0};
-    size_t m_chunk_count{0};
-    std::string m_buffer;
-    std::string m_basename;
+    struct Output {
+        std::string basename;
+        std::string buffer;
+        std::vector<std::string> shuffle_buffer;
+        size_t game_count{0};
+        size_t chunk_count{0};
+        size_t position_count{0};
+    };
+
+    std::string gen_chunk_name(const Output& output) const;
+    void add_position(Output& output, const std::string& position);
+    void end_game(Output& output);
+    void flush_chunks(Output& output);
+    void drain(Output& output);
+    Output m_train;
+    Output m_validation;
     bool m_compress{false};
+    chunk_codec_t m_codec;
+    int m_level;
+    size_t m_shuffle_size;
+    float m_validation_split;
+    Random m_rng;
 };
 
 class Training {
@@ -86,20 +168,36 @@ public:
 
     static void dump_supervised(const std::string& sgf_file,
                                 const std::string& out_filename);
+    static void dump_supervised(const std::string& sgf_file,
+                                const std::string& out_filename,
+                                size_t num_threads);
     static void save_training(const std::string& filename);
     static void load_training(const std::string& filename);
 
+    static std::vector<TrainingRecord> read_chunk(const std::string& filename);
+    static void convert_chunk(const std::string& in_filename,
+                              const std::string& out_filename);
+
+    // Games held back for shuffling by the streaming dump_supervised.
+    static constexpr size_t SUPERVISED_SHUFFLE_GAMES = 4096;
+
 private:
     static TimeStep::NNPlanes get_planes(const GameState* const state);
+    static size_t process_sgf(const std::string& sgf,
+                              OutputChunker& outchunker);
     static void process_game(GameState& state, size_t& train_pos, int who_won,
                              const std::vector<int>& tree_moves,
                              OutputChunker& outchunker);
     static void dump_training(int winner_color,
                               OutputChunker& outchunker);
+    static void dump_training(int winner_color,
+                              const std::vector<TimeStep>& data,
+                              OutputChunker& outchunker);
     static void dump_debug(OutputChunker& outchunker);
     static void save_training(std::ofstream& out);
     static void load_training(std::ifstream& in);
-    static std::vector<TimeStep> m_data;
+    // per thread, so concurrent self-play games keep their own records
+    static thread_local std::vector<TimeStep> m_data;
 };
 
 #endif
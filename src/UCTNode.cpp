@@ -35,9 +35,12 @@
 #include <algorithm>
 #include <cmath>
 #include <functional>
+#include <istream>
 #include <iterator>
 #include <limits>
 #include <numeric>
+#include <ostream>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 
@@ -480,3 +483,68 @@ void UCTNode::wait_expanded() {
     assert(v == ExpandState::EXPANDED);
 }
 
+
+void UCTNode::write_tree(std::ostream& out) const {
+    write_le(out, std::uint32_t(m_visits.load()), 4);
+    write_float_le(out, m_net_eval);
+    write_float_le(out, m_squared_eval_diff.load());
+    write_double_le(out, m_blackevals.load());
+    write_le(out, std::uint8_t(m_status.load()), 1);
+    write_float_le(out, m_min_psa_ratio_children.load());
+    write_le(out, std::uint32_t(m_children.size()), 4);
+    for (const auto& child : m_children) {
+        const auto inflated = child.is_inflated();
+        write_le(out, std::uint8_t(inflated), 1);
+        write_le(out, std::uint16_t(child.get_move()), 2);
+        write_float_le(out, child.get_policy());
+        if (inflated) {
+            child->write_tree(out);
+        }
+    }
+}
+
+static bool is_tree_move(int move, int boardsize) {
+    if (move == FastBoard::PASS || move == FastBoard::RESIGN) {
+        return true;
+    }
+    const auto x = move % (boardsize + 2) - 1;
+    const auto y = move / (boardsize + 2) - 1;
+    return move > 0 && x >= 0 && x < boardsize && y >= 0 && y < boardsize;
+}
+
+void UCTNode::read_tree(std::istream& in, int boardsize) {
+    m_visits = std::int32_t(read_le(in, 4));
+    m_net_eval = read_float_le(in);
+    m_squared_eval_diff = read_float_le(in);
+    m_blackevals = read_double_le(in);
+    const auto status = read_le(in, 1);
+    if (status > ACTIVE) {
+        throw std::runtime_error("Corrupt tree file");
+    }
+    m_status = static_cast<Status>(status);
+    m_min_psa_ratio_children = read_float_le(in);
+    // count_nodes_and_clear_expand_state lets the search expand
+    // the node further if it is not fully expanded.
+    if (has_children()) {
+        m_expand_state = ExpandState::EXPANDED;
+    }
+
+    const auto children = read_le(in, 4);
+    if (children > std::uint64_t{POTENTIAL_MOVES}) {
+        throw std::runtime_error("Corrupt tree file");
+    }
+    m_children.reserve(children);
+    for (auto i = std::uint64_t{0}; i < children; i++) {
+        const auto inflated = read_le(in, 1);
+        const auto move = std::int16_t(read_le(in, 2));
+        const auto policy = read_float_le(in);
+        if (!is_tree_move(move, boardsize)) {
+            throw std::runtime_error("Corrupt tree file");
+        }
+        m_children.emplace_back(move, policy);
+        if (inflated) {
+            m_children.back().inflate();
+            m_children.back()->read_tree(in, boardsize);
+        }
+    }
+}
@@ -38,6 +38,8 @@
 #include <cassert>
 #include <cstring>
 
+#include <iosfwd>
+
 #include "GameState.h"
 #include "Network.h"
 #include "SMP.h"
@@ -97,6 +99,14 @@ public:
     void inflate_all_children();
 
     void clear_expand_state();
+
+    // Statistics of this node and everything below it, without its
+    // own move and policy, which are written with the parent.
+    void write_tree(std::ostream& out) const;
+    // Fills a new node from what write_tree wrote for a board of
+    // boardsize, throws std::runtime_error on a truncated or corrupt
+    // stream.
+    void read_tree(std::istream& in, int boardsize);
 private:
     enum Status : char {
         INVALID, // superko
@@ -32,11 +32,19 @@
 
 #include <boost/format.hpp>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <condition_variable>
 #include <cstddef>
+#include <cstring>
+#include <fstream>
 #include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <algorithm>
 
@@ -45,6 +53,7 @@
 #include "FullBoard.h"
 #include "GTP.h"
 #include "GameState.h"
+#include "SearchBook.h"
 #include "TimeControl.h"
 #include "Timing.h"
 #include "Training.h"
@@ -82,6 +91,35 @@ public:
         return tmp;
     }
 
+    std::string get_json_string(int order) const {
+        auto tmp = "{\"move\":\"" + m_move + "\""
+                 + ",\"visits\":" + std::to_string(m_visits)
+                 + ",\"winrate\":" + json_number(m_winrate)
+                 + ",\"prior\":" + json_number(m_policy_prior)
+                 + ",\"lcb\":" + json_number(std::max(0.0f, m_lcb))
+                 + ",\"order\":" + std::to_string(order)
+                 + ",\"pv\":[\"";
+        for (const auto c : m_pv) {
+            if (c == ' ') {
+                tmp += "\",\"";
+            } else {
+                tmp += c;
+            }
+        }
+        tmp += "\"]}";
+        return tmp;
+    }
+
+    const std::string& get_move() const {
+        return m_move;
+    }
+
+    static std::string json_number(float value) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.4f", value);
+        return buffer;
+    }
+
     friend bool operator<(const OutputAnalysisData& a,
                           const OutputAnalysisData& b) {
         if (a.m_lcb_ratio_exceeded && b.m_lcb_ratio_exceeded) {
@@ -105,6 +143,47 @@ private:
     bool m_lcb_ratio_exceeded;
 };
 
+// Posts lz-analyze output every interval from a thread of its own, so
+// the search thread keeps running playouts in the meantime.
+class AnalysisReporter {
+public:
+    AnalysisReporter(int interval_centis, std::function<void()> report)
+        : m_thread([this, interval_centis, report] {
+            const auto interval = std::chrono::milliseconds(10 * interval_centis);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_condvar.wait_for(lock, interval, [this] { return m_stop; })) {
+                lock.unlock();
+                report();
+                m_reports++;
+                lock.lock();
+            }
+        }) {}
+
+    ~AnalysisReporter() {
+        stop();
+    }
+
+    // Returns how many times the analysis was posted.
+    int stop() {
+        if (m_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_condvar.notify_one();
+            m_thread.join();
+        }
+        return m_reports;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condvar;
+    bool m_stop{false};
+    int m_reports{0};
+    std::thread m_thread;
+};
+
 
 UCTSearch::UCTSearch(GameState& g, Network& network)
     : m_rootstate(g), m_network(network) {
@@ -188,6 +267,8 @@ void UCTSearch::update_root() {
     // Definition of m_playouts is playouts per search call.
     // So reset this count now.
     m_playouts = 0;
+    m_pv_cache.clear();
+    m_posted_analysis.clear();
 
 #ifndef NDEBUG
     auto start_nodes = m_root->count_nodes_and_clear_expand_state();
@@ -210,8 +291,22 @@ void UCTSearch::update_root() {
 #endif
 }
 
+float UCTSearch::get_session_memory_ratio() const {
+    if (cfg_session_memory == 0) {
+        return 0.0f;
+    }
+    // The tree size counter is shared by every search in the process,
+    // so estimate this tree from its own node count, as if every node
+    // had been inflated.
+    const auto estimate =
+        m_nodes.load() * (sizeof(UCTNodePointer) + sizeof(UCTNode));
+    return estimate / static_cast<float>(cfg_session_memory);
+}
+
 float UCTSearch::get_min_psa_ratio() const {
-    const auto mem_full = UCTNodePointer::get_tree_size() / static_cast<float>(cfg_max_tree_size);
+    const auto mem_full = std::max(
+        UCTNodePointer::get_tree_size() / static_cast<float>(cfg_max_tree_size),
+        get_session_memory_ratio());
     // If we are halfway through our memory budget, start trimming
     // moves with very low policy priors.
     if (mem_full > 0.5f) {
@@ -290,6 +385,10 @@ void UCTSearch::dump_stats(FastState & state, UCTNode & parent) {
         return;
     }
 
+    // The search threads may still read state, walk lines on a copy.
+    auto tmpstate = FastState{state};
+    auto undo = FastState::MoveUndo{};
+
     int movecount = 0;
     for (const auto& node : parent.get_children()) {
         // Always display at least two moves. In the case there is
@@ -297,9 +396,9 @@ void UCTSearch::dump_stats(FastState & state, UCTNode & parent) {
         if (++movecount > 2 && !node->get_visits()) break;
 
         auto move = state.move_to_text(node->get_move());
-        auto tmpstate = FastState{state};
-        tmpstate.play_move(node->get_move());
+        tmpstate.play_move(node->get_move(), undo);
         auto pv = move + " " + get_pv(tmpstate, *node);
+        tmpstate.unplay_move(undo);
 
         myprintf("%4s -> %7d (V: %5.2f%%) (LCB: %5.2f%%) (N: %5.2f%%) PV: %s\n",
             move.c_str(),
@@ -327,6 +426,7 @@ void UCTSearch::output_analysis(FastState & state, UCTNode & parent) {
         max_visits = std::max(max_visits, node->get_visits());
     }
 
+    sortable_data.reserve(parent.get_children().size());
     for (const auto& node : parent.get_children()) {
         // Send only variations with visits, unless more moves were
         // requested explicitly.
@@ -335,10 +435,23 @@ void UCTSearch::output_analysis(FastState & state, UCTNode & parent) {
             continue;
         }
         auto move = state.move_to_text(node->get_move());
-        auto tmpstate = FastState{state};
-        tmpstate.play_move(node->get_move());
-        auto rest_of_pv = get_pv(tmpstate, *node);
-        auto pv = move + (rest_of_pv.empty() ? "" : " " + rest_of_pv);
+        // Lines rarely change between two outputs, only rebuild the
+        // text of those that did.
+        m_pv_moves.clear();
+        m_pv_moves.push_back(node->get_move());
+        get_pv_moves(!color, *node, m_pv_moves);
+        auto& cached = m_pv_cache[node->get_move()];
+        if (cached.moves != m_pv_moves) {
+            cached.moves = m_pv_moves;
+            cached.text.clear();
+            for (const auto pv_move : m_pv_moves) {
+                if (!cached.text.empty()) {
+                    cached.text += ' ';
+                }
+                cached.text += state.move_to_text(pv_move);
+            }
+        }
+        const auto& pv = cached.text;
         auto move_eval = node->get_visits() ? node->get_raw_eval(color) : 0.0f;
         auto policy = node->get_policy();
         auto lcb = node->get_eval_lcb(color);
@@ -353,6 +466,11 @@ void UCTSearch::output_analysis(FastState & state, UCTNode & parent) {
     // Sort array to decide order
     std::stable_sort(rbegin(sortable_data), rend(sortable_data));
 
+    if (cfg_analyze_tags.format() == AnalyzeTags::JSON) {
+        output_analysis_json(state, parent, sortable_data);
+        return;
+    }
+
     auto i = 0;
     // Output analysis data in gtp stream
     for (const auto& node : sortable_data) {
@@ -365,6 +483,60 @@ void UCTSearch::output_analysis(FastState & state, UCTNode & parent) {
     gtp_printf_raw("\n");
 }
 
+void UCTSearch::output_analysis_json(
+    FastState & state, UCTNode & parent,
+    const std::vector<OutputAnalysisData>& sortable_data) {
+    // One JSON object per line. With deltas, only the moves whose entry
+    // changed since the last line of this search are sent.
+    const auto deltas = cfg_analyze_tags.deltas();
+    auto line = std::string{"{\"delta\":"};
+    line += deltas && !m_posted_analysis.empty() ? "true" : "false";
+    line += ",\"moves\":[";
+    auto first = true;
+    auto order = 0;
+    for (const auto& data : sortable_data) {
+        auto entry = data.get_json_string(order++);
+        if (deltas) {
+            auto& posted = m_posted_analysis[data.get_move()];
+            if (posted == entry) {
+                continue;
+            }
+            posted = entry;
+        }
+        if (!first) {
+            line += ',';
+        }
+        first = false;
+        line += entry;
+    }
+    line += ']';
+
+    if (cfg_analyze_tags.with_policy()) {
+        // Priors in the order a1, b1, ..., then pass.
+        const auto size = state.board.get_boardsize();
+        auto policy = std::vector<float>(size * size + 1, 0.0f);
+        for (const auto& node : parent.get_children()) {
+            const auto move = node->get_move();
+            if (move == FastBoard::PASS) {
+                policy.back() = node->get_policy();
+            } else {
+                const auto xy = state.board.get_xy(move);
+                policy[xy.second * size + xy.first] = node->get_policy();
+            }
+        }
+        line += ",\"policy\":[";
+        for (auto i = size_t{0}; i < policy.size(); i++) {
+            if (i > 0) {
+                line += ',';
+            }
+            line += OutputAnalysisData::json_number(policy[i]);
+        }
+        line += ']';
+    }
+    line += "}\n";
+    gtp_printf_raw("%s", line.c_str());
+}
+
 void UCTSearch::tree_stats(const UCTNode& node) {
     size_t nodes = 0;
     size_t non_leaf_nodes = 0;
@@ -588,6 +760,36 @@ int UCTSearch::get_best_move(passflag_t passflag) {
     return bestmove;
 }
 
+void UCTSearch::get_pv_moves(int color, UCTNode& parent,
+                             std::vector<int>& moves) {
+    // The same walk as get_pv(), without playing the moves on a state.
+    auto node = &parent;
+    while (node->has_children() && !node->expandable()) {
+        auto& best_child = node->get_best_root_child(color);
+        if (best_child.first_visit()) {
+            break;
+        }
+        moves.push_back(best_child.get_move());
+        node = &best_child;
+        color = !color;
+    }
+}
+
+std::unique_ptr<AnalysisReporter> UCTSearch::start_analysis_reporter() {
+    if (!cfg_analyze_tags.interval_centis()) {
+        return nullptr;
+    }
+    // The reporter writes to this thread's GTP channel, with its tags.
+    const auto channel = Utils::get_gtp_channel();
+    const auto tags = cfg_analyze_tags;
+    return std::make_unique<AnalysisReporter>(tags.interval_centis(),
+        [this, channel, tags] {
+            Utils::set_gtp_channel(channel);
+            cfg_analyze_tags = tags;
+            output_analysis(m_rootstate, *m_root);
+        });
+}
+
 std::string UCTSearch::get_pv(FastState & state, UCTNode& parent) {
     if (!parent.has_children()) {
         return std::string();
@@ -608,9 +810,11 @@ std::string UCTSearch::get_pv(FastState & state, UCTNode& parent) {
     auto best_move = best_child.get_move();
     auto res = state.move_to_text(best_move);
 
-    state.play_move(best_move);
-
+    auto undo = FastState::MoveUndo{};
+    state.play_move(best_move, undo);
     auto next = get_pv(state, best_child);
+    state.unplay_move(undo);
+
     if (!next.empty()) {
         res.append(" ").append(next);
     }
@@ -628,7 +832,8 @@ std::string UCTSearch::get_analysis(int playouts) {
 }
 
 bool UCTSearch::is_running() const {
-    return m_run && UCTNodePointer::get_tree_size() < cfg_max_tree_size;
+    return m_run && UCTNodePointer::get_tree_size() < cfg_max_tree_size
+        && get_session_memory_ratio() < 1.0f;
 }
 
 int UCTSearch::est_playouts_left(int elapsed_centis, int time_for_move) const {
@@ -730,9 +935,17 @@ bool UCTSearch::stop_thinking(int elapsed_centis, int time_for_move) const {
            || elapsed_centis >= time_for_move;
 }
 
+UCTWorker::UCTWorker(GameState & state, UCTSearch * search, UCTNode * root)
+    : m_rootstate(state), m_search(search), m_root(root),
+      m_analyze_tags(&cfg_analyze_tags) {}
+
 void UCTWorker::operator()() {
+    // The analyze tags belong to the thread that started the search,
+    // pool threads pick up the ones of the search they work for.
+    cfg_analyze_tags = *m_analyze_tags;
     do {
         auto currstate = std::make_unique<GameState>(m_rootstate);
+        SearchScheduler::Slot slot(m_search->scheduler_client());
         auto result = m_search->play_simulation(*currstate, m_root);
         if (result.valid()) {
             m_search->increment_playouts();
@@ -744,6 +957,26 @@ void UCTSearch::increment_playouts() {
     m_playouts++;
 }
 
+SearchScheduler::Client& UCTSearch::scheduler_client() {
+    return m_scheduler_client;
+}
+
+// Analysis clients get one line for a book move, as they would for
+// the shortest search.
+static void output_book_analysis(FastState& state,
+                                 const SearchBook::Move& book_move) {
+    const auto move = state.move_to_text(book_move.move);
+    const auto data = OutputAnalysisData(move, book_move.visits,
+                                         book_move.eval, book_move.policy,
+                                         move, book_move.eval, false);
+    if (cfg_analyze_tags.format() == AnalyzeTags::JSON) {
+        gtp_printf_raw("{\"delta\":false,\"moves\":[%s]}\n",
+                       data.get_json_string(0).c_str());
+    } else {
+        gtp_printf_raw("%s\n", data.get_info_string(0).c_str());
+    }
+}
+
 int UCTSearch::think(int color, passflag_t passflag) {
     // Start counting time for us
     m_rootstate.start_clock(color);
@@ -755,6 +988,29 @@ int UCTSearch::think(int color, passflag_t passflag) {
     // set side to move
     m_rootstate.board.set_to_move(color);
 
+    // Book moves are played without searching. Self-play would lose
+    // its randomness, so it only adds to the book.
+    auto book_move = SearchBook::Move{};
+    if (!cfg_book_file.empty() && !cfg_noise && !cfg_random_cnt
+        && !cfg_analyze_tags.has_move_restrictions()
+        && SearchBook::get().best_move(m_rootstate, !(passflag & NOPASS),
+                                       book_move)) {
+        m_rootstate.stop_clock(color);
+        myprintf("Book move %s: %d visits, %5.2f%% winrate\n",
+                 m_rootstate.move_to_text(book_move.move).c_str(),
+                 book_move.visits, book_move.eval * 100.0f);
+        m_think_output =
+            str(boost::format("move %d, %c => %s (book)\n")
+            % m_rootstate.get_movenum()
+            % (color == FastBoard::BLACK ? 'B' : 'W')
+            % m_rootstate.move_to_text(book_move.move).c_str());
+        if (cfg_analyze_tags.interval_centis()) {
+            output_book_analysis(m_rootstate, book_move);
+        }
+        m_last_rootstate = std::make_unique<GameState>(m_rootstate);
+        return book_move.move;
+    }
+
     auto time_for_move =
         m_rootstate.get_timecontrol().max_time_for_move(
             m_rootstate.board.get_boardsize(),
@@ -767,19 +1023,24 @@ int UCTSearch::think(int color, passflag_t passflag) {
     m_root->prepare_root_node(m_network, color, m_nodes, m_rootstate);
 
     m_run = true;
+    m_scheduler_client.begin(SearchScheduler::INTERACTIVE);
     int cpus = cfg_num_threads;
     ThreadGroup tg(thread_pool);
     for (int i = 1; i < cpus; i++) {
         tg.add_task(UCTWorker(m_rootstate, this, m_root.get()));
     }
 
+    auto reporter = start_analysis_reporter();
     auto keeprunning = true;
     auto last_update = 0;
-    auto last_output = 0;
     do {
         auto currstate = std::make_unique<GameState>(m_rootstate);
 
-        auto result = play_simulation(*currstate, m_root.get());
+        auto result = SearchResult{};
+        {
+            SearchScheduler::Slot slot(m_scheduler_client);
+            result = play_simulation(*currstate, m_root.get());
+        }
         if (result.valid()) {
             increment_playouts();
         }
@@ -787,12 +1048,6 @@ int UCTSearch::think(int color, passflag_t passflag) {
         Time elapsed;
         int elapsed_centis = Time::timediff_centis(start, elapsed);
 
-        if (cfg_analyze_tags.interval_centis() &&
-            elapsed_centis - last_output > cfg_analyze_tags.interval_centis()) {
-            last_output = elapsed_centis;
-            output_analysis(m_rootstate, *m_root);
-        }
-
         // output some stats every few seconds
         // check if we should still search
         if (!cfg_quiet && elapsed_centis - last_update > 250) {
@@ -805,13 +1060,14 @@ int UCTSearch::think(int color, passflag_t passflag) {
     } while (keeprunning);
 
     // Make sure to post at least once.
-    if (cfg_analyze_tags.interval_centis() && last_output == 0) {
+    if (reporter && reporter->stop() == 0) {
         output_analysis(m_rootstate, *m_root);
     }
 
     // Stop the search.
     m_run = false;
     tg.wait_all();
+    m_scheduler_client.end();
 
     // Reactivate all pruned root children.
     for (const auto& node : m_root->get_children()) {
@@ -827,14 +1083,18 @@ int UCTSearch::think(int color, passflag_t passflag) {
     myprintf("\n");
     dump_stats(m_rootstate, *m_root);
     Training::record(m_network, m_rootstate, *m_root);
+    if (cfg_book_update && !cfg_analyze_tags.has_move_restrictions()) {
+        SearchBook::get().record(m_rootstate, *m_root);
+    }
 
     Time elapsed;
     int elapsed_centis = Time::timediff_centis(start, elapsed);
-    myprintf("%d visits, %d nodes, %d playouts, %.0f n/s\n\n",
+    myprintf("%d visits, %d nodes, %d playouts, %.0f n/s, %.2f ms queue wait\n\n",
              m_root->get_visits(),
              m_nodes.load(),
              m_playouts.load(),
-             (m_playouts * 100.0) / (elapsed_centis+1));
+             (m_playouts * 100.0) / (elapsed_centis+1),
+             m_scheduler_client.mean_wait_ms());
 
 #ifdef USE_OPENCL
 #ifndef NDEBUG
@@ -865,6 +1125,66 @@ std::string UCTSearch::explain_last_think() const {
     return m_think_output;
 }
 
+static constexpr char TREE_FILE_MAGIC[8] = {'L', 'Z', 'T', 'R', 'E', 'E', '0', '1'};
+
+// Bumped whenever the layout of the header or the nodes changes.
+static constexpr std::uint32_t TREE_FILE_VERSION = 2;
+
+int UCTSearch::save_tree(const std::string& filename) {
+    // Walk the tree down to the current position, and keep it for
+    // the next search.
+    update_root();
+    m_last_rootstate = std::make_unique<GameState>(m_rootstate);
+
+    auto out = std::ofstream{filename, std::ofstream::binary};
+    if (!out) {
+        throw std::runtime_error("Error opening file");
+    }
+    out.write(TREE_FILE_MAGIC, sizeof(TREE_FILE_MAGIC));
+    write_le(out, TREE_FILE_VERSION, 4);
+    write_le(out, m_network.get_weights_hash(), 8);
+    write_le(out, m_rootstate.board.get_hash(), 8);
+    write_float_le(out, m_rootstate.get_komi());
+    m_root->write_tree(out);
+    if (!out.flush()) {
+        throw std::runtime_error("Error writing file");
+    }
+    return m_root->get_visits();
+}
+
+int UCTSearch::load_tree(const std::string& filename) {
+    auto in = std::ifstream{filename, std::ifstream::binary};
+    if (!in) {
+        throw std::runtime_error("Error opening file");
+    }
+    char magic[sizeof(TREE_FILE_MAGIC)];
+    if (!in.read(magic, sizeof(magic))
+        || std::memcmp(magic, TREE_FILE_MAGIC, sizeof(magic))) {
+        throw std::runtime_error("Not a tree file");
+    }
+    if (read_le(in, 4) != TREE_FILE_VERSION) {
+        throw std::runtime_error("Unsupported tree file version");
+    }
+    if (read_le(in, 8) != m_network.get_weights_hash()) {
+        throw std::runtime_error("Tree of another network");
+    }
+    const auto position_hash = read_le(in, 8);
+    const auto komi = read_float_le(in);
+    if (position_hash != m_rootstate.board.get_hash()
+        || komi != m_rootstate.get_komi()) {
+        throw std::runtime_error("Tree of another position");
+    }
+
+    auto root = std::make_unique<UCTNode>(FastBoard::PASS, 0.0f);
+    root->read_tree(in, m_rootstate.board.get_boardsize());
+
+    // The next search reuses it as if it had searched this position.
+    m_root = std::move(root);
+    m_last_rootstate = std::make_unique<GameState>(m_rootstate);
+    m_nodes = m_root->count_nodes_and_clear_expand_state();
+    return m_root->get_visits();
+}
+
 void UCTSearch::ponder() {
     auto disable_reuse = cfg_analyze_tags.has_move_restrictions();
     if (disable_reuse) {
@@ -877,45 +1197,49 @@ void UCTSearch::ponder() {
                               m_nodes, m_rootstate);
 
     m_run = true;
+    m_scheduler_client.begin(SearchScheduler::BACKGROUND);
     ThreadGroup tg(thread_pool);
     for (auto i = size_t{1}; i < cfg_num_threads; i++) {
         tg.add_task(UCTWorker(m_rootstate, this, m_root.get()));
     }
-    Time start;
+    auto reporter = start_analysis_reporter();
     auto keeprunning = true;
-    auto last_output = 0;
     do {
         auto currstate = std::make_unique<GameState>(m_rootstate);
-        auto result = play_simulation(*currstate, m_root.get());
+        auto result = SearchResult{};
+        {
+            SearchScheduler::Slot slot(m_scheduler_client);
+            result = play_simulation(*currstate, m_root.get());
+        }
         if (result.valid()) {
             increment_playouts();
         }
-        if (cfg_analyze_tags.interval_centis()) {
-            Time elapsed;
-            int elapsed_centis = Time::timediff_centis(start, elapsed);
-            if (elapsed_centis - last_output > cfg_analyze_tags.interval_centis()) {
-                last_output = elapsed_centis;
-                output_analysis(m_rootstate, *m_root);
-            }
-        }
         keeprunning  = is_running();
         keeprunning &= !stop_thinking(0, 1);
     } while (!Utils::input_pending() && keeprunning);
 
     // Make sure to post at least once.
-    if (cfg_analyze_tags.interval_centis() && last_output == 0) {
+    if (reporter && reporter->stop() == 0) {
         output_analysis(m_rootstate, *m_root);
     }
 
     // Stop the search.
     m_run = false;
     tg.wait_all();
+    m_scheduler_client.end();
 
     // Display search info.
     myprintf("\n");
     dump_stats(m_rootstate, *m_root);
 
-    myprintf("\n%d visits, %d nodes\n\n", m_root->get_visits(), m_nodes.load());
+    myprintf("\n%d visits, %d nodes, %.0f p/s, %.2f ms queue wait\n\n",
+             m_root->get_visits(), m_nodes.load(),
+             m_scheduler_client.playouts_per_second(),
+             m_scheduler_client.mean_wait_ms());
+
+    if (cfg_book_update && !disable_reuse) {
+        SearchBook::get().record(m_rootstate, *m_root);
+    }
 
     // Copy the root state. Use to check for tree re-use in future calls.
     if (!disable_reuse) {
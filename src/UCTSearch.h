@@ -35,6 +35,8 @@
 #include <memory>
 #include <string>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 #include <future>
 
 #include "ThreadPool.h"
@@ -43,6 +45,11 @@
 #include "GameState.h"
 #include "UCTNode.h"
 #include "Network.h"
+#include "SearchScheduler.h"
+
+class AnalyzeTags;
+class AnalysisReporter;
+class OutputAnalysisData;
 
 
 class SearchResult {
@@ -115,10 +122,16 @@ public:
     bool is_running() const;
     void increment_playouts();
     std::string explain_last_think() const;
+    // The tree of the current position, tied to it and the network.
+    // Both return the root visits and throw std::runtime_error.
+    int save_tree(const std::string& filename);
+    int load_tree(const std::string& filename);
     SearchResult play_simulation(GameState& currstate, UCTNode* const node);
+    SearchScheduler::Client& scheduler_client();
 
 private:
     float get_min_psa_ratio() const;
+    float get_session_memory_ratio() const;
     void dump_stats(FastState& state, UCTNode& parent);
     void tree_stats(const UCTNode& node);
     std::string get_pv(FastState& state, UCTNode& parent);
@@ -133,6 +146,10 @@ private:
     void update_root();
     bool advance_to_new_rootstate();
     void output_analysis(FastState & state, UCTNode & parent);
+    void output_analysis_json(FastState & state, UCTNode & parent,
+        const std::vector<OutputAnalysisData>& sortable_data);
+    std::unique_ptr<AnalysisReporter> start_analysis_reporter();
+    void get_pv_moves(int color, UCTNode& parent, std::vector<int>& moves);
 
     GameState & m_rootstate;
     std::unique_ptr<GameState> m_last_rootstate;
@@ -146,18 +163,31 @@ private:
 
     std::list<Utils::ThreadGroup> m_delete_futures;
 
+    SearchScheduler::Client m_scheduler_client;
+
+    // PV text of each root move from the last analysis output, reused
+    // while its line stays the same.
+    struct PVText {
+        std::vector<int> moves;
+        std::string text;
+    };
+    std::unordered_map<int, PVText> m_pv_cache;
+    std::vector<int> m_pv_moves;
+    // Last JSON entry posted for each move, for delta output.
+    std::unordered_map<std::string, std::string> m_posted_analysis;
+
     Network & m_network;
 };
 
 class UCTWorker {
 public:
-    UCTWorker(GameState & state, UCTSearch * search, UCTNode * root)
-      : m_rootstate(state), m_search(search), m_root(root) {}
+    UCTWorker(GameState & state, UCTSearch * search, UCTNode * root);
     void operator()();
 private:
     GameState & m_rootstate;
     UCTSearch * m_search;
     UCTNode * m_root;
+    const AnalyzeTags * m_analyze_tags;
 };
 
 #endif
@@ -30,9 +30,18 @@
 #include "config.h"
 #include "Utils.h"
 
+#include <cassert>
 #include <mutex>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
+#include <deque>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/math/distributions/students_t.hpp>
@@ -50,6 +59,9 @@
 
 Utils::ThreadPool thread_pool;
 
+static thread_local Utils::GTPChannel* s_gtp_channel = nullptr;
+static Utils::LineReader* s_stdin_reader = nullptr;
+
 auto constexpr z_entries = 1000;
 std::array<float, z_entries> z_lookup;
 
@@ -74,7 +86,73 @@ float Utils::cached_t_quantile(int v) {
     return z_lookup[z_entries - 1];
 }
 
+void Utils::set_gtp_channel(GTPChannel* channel) {
+    s_gtp_channel = channel;
+}
+
+Utils::GTPChannel* Utils::get_gtp_channel() {
+    return s_gtp_channel;
+}
+
+struct Utils::LineReader::State {
+    std::mutex mutex;
+    std::condition_variable condvar;
+    std::deque<std::string> lines;
+    bool ended{false};
+    std::atomic<bool> pending{false};
+};
+
+Utils::LineReader::LineReader(std::function<bool(std::string&)> read_line)
+    : m_state(std::make_shared<State>()) {
+    // The thread may still be blocked in read_line when we are gone,
+    // so it keeps the state alive and is never joined.
+    auto state = m_state;
+    std::thread([state, read_line] {
+        auto line = std::string{};
+        while (read_line(line)) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->lines.emplace_back(std::move(line));
+            state->pending = true;
+            state->condvar.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->ended = true;
+        state->pending = true;
+        state->condvar.notify_one();
+    }).detach();
+}
+
+Utils::LineReader::~LineReader() = default;
+
+bool Utils::LineReader::get_line(std::string& line) {
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    m_state->condvar.wait(lock, [this] {
+        return !m_state->lines.empty() || m_state->ended;
+    });
+    if (m_state->lines.empty()) {
+        return false;
+    }
+    line = std::move(m_state->lines.front());
+    m_state->lines.pop_front();
+    m_state->pending = !m_state->lines.empty() || m_state->ended;
+    return true;
+}
+
+bool Utils::LineReader::pending() const {
+    return m_state->pending.load(std::memory_order_relaxed);
+}
+
+void Utils::set_stdin_reader(LineReader* reader) {
+    s_stdin_reader = reader;
+}
+
 bool Utils::input_pending() {
+    if (s_gtp_channel) {
+        return s_gtp_channel->input_pending();
+    }
+    if (s_stdin_reader) {
+        return s_stdin_reader->pending();
+    }
 #ifdef HAVE_SELECT
     fd_set read_fds;
     FD_ZERO(&read_fds);
@@ -149,11 +227,40 @@ void Utils::myprintf_error(const char *fmt, ...) {
     va_end(ap);
 }
 
-static void gtp_fprintf(FILE* file, const std::string& prefix,
-                        const char *fmt, va_list ap) {
-    fprintf(file, "%s ", prefix.c_str());
-    vfprintf(file, fmt, ap);
-    fprintf(file, "\n\n");
+static std::string gtp_vformat(const char *fmt, va_list ap) {
+    // Most responses fit, so usually this formats only once.
+    char small[256];
+    va_list size_ap;
+    va_copy(size_ap, ap);
+    const auto size = vsnprintf(small, sizeof(small), fmt, size_ap);
+    va_end(size_ap);
+    if (size < 0) {
+        return {};
+    }
+    if (size_t(size) < sizeof(small)) {
+        return std::string(small, size);
+    }
+    auto buffer = std::vector<char>(size + 1);
+    vsnprintf(buffer.data(), buffer.size(), fmt, ap);
+    return std::string(buffer.data(), size);
+}
+
+// One write per response. In GTP mode stdout is buffered, and only
+// flushed once no further command is waiting, so a client that sends
+// many commands at once gets the answers in few writes.
+static void gtp_write(const std::string& text) {
+    if (s_gtp_channel) {
+        s_gtp_channel->write(text);
+    } else {
+        fwrite(text.data(), 1, text.size(), stdout);
+        if (!s_stdin_reader || !s_stdin_reader->pending()) {
+            fflush(stdout);
+        }
+    }
+    if (cfg_logfile_handle) {
+        std::lock_guard<std::mutex> lock(IOmutex);
+        fwrite(text.data(), 1, text.size(), cfg_logfile_handle);
+    }
 }
 
 static void gtp_base_printf(int id, std::string prefix,
@@ -161,11 +268,7 @@ static void gtp_base_printf(int id, std::string prefix,
     if (id != -1) {
         prefix += std::to_string(id);
     }
-    gtp_fprintf(stdout, prefix, fmt, ap);
-    if (cfg_logfile_handle) {
-        std::lock_guard<std::mutex> lock(IOmutex);
-        gtp_fprintf(cfg_logfile_handle, prefix, fmt, ap);
-    }
+    gtp_write(prefix + " " + gtp_vformat(fmt, ap) + "\n\n");
 }
 
 void Utils::gtp_printf(int id, const char *fmt, ...) {
@@ -178,15 +281,9 @@ void Utils::gtp_printf(int id, const char *fmt, ...) {
 void Utils::gtp_printf_raw(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
-    vfprintf(stdout, fmt, ap);
+    const auto text = gtp_vformat(fmt, ap);
     va_end(ap);
-
-    if (cfg_logfile_handle) {
-        std::lock_guard<std::mutex> lock(IOmutex);
-        va_start(ap, fmt);
-        vfprintf(cfg_logfile_handle, fmt, ap);
-        va_end(ap);
-    }
+    gtp_write(text);
 }
 
 void Utils::gtp_fail_printf(int id, const char *fmt, ...) {
@@ -203,6 +300,54 @@ void Utils::log_input(const std::string& input) {
     }
 }
 
+void Utils::write_le(std::ostream& out, std::uint64_t value, size_t bytes) {
+    assert(bytes <= sizeof(value));
+    char data[sizeof(value)];
+    for (auto i = size_t{0}; i < bytes; i++) {
+        data[i] = static_cast<char>(value >> (8 * i));
+    }
+    out.write(data, bytes);
+}
+
+std::uint64_t Utils::read_le(std::istream& in, size_t bytes) {
+    assert(bytes <= sizeof(std::uint64_t));
+    unsigned char data[sizeof(std::uint64_t)];
+    if (!in.read(reinterpret_cast<char*>(data), bytes)) {
+        throw std::runtime_error("Unexpected end of file");
+    }
+    auto value = std::uint64_t{0};
+    for (auto i = bytes; i-- > 0; ) {
+        value = value << 8 | data[i];
+    }
+    return value;
+}
+
+void Utils::write_float_le(std::ostream& out, float value) {
+    auto bits = std::uint32_t{};
+    std::memcpy(&bits, &value, sizeof(bits));
+    write_le(out, bits, sizeof(bits));
+}
+
+float Utils::read_float_le(std::istream& in) {
+    const auto bits = std::uint32_t(read_le(in, sizeof(std::uint32_t)));
+    auto value = float{};
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void Utils::write_double_le(std::ostream& out, double value) {
+    auto bits = std::uint64_t{};
+    std::memcpy(&bits, &value, sizeof(bits));
+    write_le(out, bits, sizeof(bits));
+}
+
+double Utils::read_double_le(std::istream& in) {
+    const auto bits = read_le(in, sizeof(std::uint64_t));
+    auto value = double{};
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
 size_t Utils::ceilMultiple(size_t a, size_t b) {
     if (a % b == 0) {
         return a;
@@ -33,7 +33,11 @@
 #include "config.h"
 
 #include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
 #include <limits>
+#include <memory>
 #include <string>
 
 #include "ThreadPool.h"
@@ -49,6 +53,40 @@ namespace Utils {
     void log_input(const std::string& input);
     bool input_pending();
 
+    // Where GTP responses go and where input_pending() looks for the
+    // next command. Threads use stdout and stdin unless they install
+    // a channel of their own, as server sessions do.
+    class GTPChannel {
+    public:
+        virtual ~GTPChannel() = default;
+        virtual void write(const std::string& text) = 0;
+        virtual bool input_pending() = 0;
+    };
+    void set_gtp_channel(GTPChannel* channel);
+    GTPChannel* get_gtp_channel();
+
+    // Reads lines on a thread of its own, so that a search can check
+    // for pending input with an atomic load instead of a system call.
+    class LineReader {
+    public:
+        // read_line returns false once input has ended.
+        explicit LineReader(std::function<bool(std::string&)> read_line);
+        ~LineReader();
+        LineReader(const LineReader&) = delete;
+        LineReader& operator=(const LineReader&) = delete;
+
+        // Waits for the next line, false once input has ended.
+        bool get_line(std::string& line);
+        // A line is waiting, or input has ended.
+        bool pending() const;
+
+    private:
+        struct State;
+        std::shared_ptr<State> m_state;
+    };
+    // Where input_pending() looks for stdin lines, instead of polling.
+    void set_stdin_reader(LineReader* reader);
+
     template<class T>
     void atomic_add(std::atomic<T> &f, T d) {
         T old = f.load();
@@ -64,6 +102,15 @@ namespace Utils {
         return c >= 0 && c <= 127;
     }
 
+    // Fixed width little endian values, for files that are read on
+    // other machines. Reading throws std::runtime_error at the end.
+    void write_le(std::ostream& out, std::uint64_t value, size_t bytes);
+    std::uint64_t read_le(std::istream& in, size_t bytes);
+    void write_float_le(std::ostream& out, float value);
+    float read_float_le(std::istream& in);
+    void write_double_le(std::ostream& out, double value);
+    double read_double_le(std::istream& in);
+
     size_t ceilMultiple(size_t a, size_t b);
 
     const std::string leelaz_file(std::string file);
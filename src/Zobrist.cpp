@@ -29,12 +29,31 @@
 
 #include "config.h"
 #include "Zobrist.h"
+#include "Network.h"
 #include "Random.h"
 
+static_assert(Zobrist::NUM_SYMMETRIES == Network::NUM_SYMMETRIES,
+              "Zobrist and Network disagree on the number of symmetries");
+
 std::array<std::array<std::uint64_t, FastBoard::NUM_VERTICES>,     4> Zobrist::zobrist;
 std::array<std::uint64_t, FastBoard::NUM_VERTICES>                    Zobrist::zobrist_ko;
 std::array<std::array<std::uint64_t, FastBoard::NUM_VERTICES * 2>, 2> Zobrist::zobrist_pris;
 std::array<std::uint64_t, 5>                                          Zobrist::zobrist_pass;
+std::array<std::array<Zobrist::SymmetryKeys, FastBoard::NUM_VERTICES>, 4> Zobrist::zobrist_sym;
+std::array<Zobrist::SymmetryKeys, FastBoard::NUM_VERTICES>                Zobrist::zobrist_ko_sym;
+
+// Map a vertex of a BOARD_SIZE board through a symmetry.
+// Vertices outside the board (including NO_VERTEX) map to themselves.
+static int symmetry_vertex(const int vertex, const int symmetry) {
+    constexpr auto sidevertices = BOARD_SIZE + 2;
+    const auto x = (vertex % sidevertices) - 1;
+    const auto y = (vertex / sidevertices) - 1;
+    if (x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE) {
+        return vertex;
+    }
+    const auto newvtx = Network::get_symmetry({x, y}, symmetry);
+    return (newvtx.second + 1) * sidevertices + (newvtx.first + 1);
+}
 
 void Zobrist::init_zobrist(Random& rng) {
     for (int i = 0; i < 4; i++) {
@@ -56,4 +75,16 @@ void Zobrist::init_zobrist(Random& rng) {
     for (int i = 0; i < 5; i++) {
         Zobrist::zobrist_pass[i]  = rng.randuint64();
     }
+
+    // Derived tables, these don't consume random numbers so the
+    // hashes above stay stable.
+    for (int j = 0; j < FastBoard::NUM_VERTICES; j++) {
+        for (int s = 0; s < NUM_SYMMETRIES; s++) {
+            const auto vertex = symmetry_vertex(j, s);
+            for (int i = 0; i < 4; i++) {
+                Zobrist::zobrist_sym[i][j][s] = Zobrist::zobrist[i][vertex];
+            }
+            Zobrist::zobrist_ko_sym[j][s] = Zobrist::zobrist_ko[vertex];
+        }
+    }
 }
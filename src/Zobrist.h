@@ -42,11 +42,22 @@ public:
     static constexpr auto zobrist_empty = 0x1234567887654321;
     static constexpr auto zobrist_blacktomove = 0xABCDABCDABCDABCD;
 
+    // Must match Network::NUM_SYMMETRIES.
+    static constexpr auto NUM_SYMMETRIES = 8;
+
     static std::array<std::array<std::uint64_t, FastBoard::NUM_VERTICES>,     4> zobrist;
     static std::array<std::uint64_t, FastBoard::NUM_VERTICES>                    zobrist_ko;
     static std::array<std::array<std::uint64_t, FastBoard::NUM_VERTICES * 2>, 2> zobrist_pris;
     static std::array<std::uint64_t, 5>                                          zobrist_pass;
 
+    // zobrist and zobrist_ko with the vertex transformed by each board
+    // symmetry, so all symmetric hashes can be updated incrementally.
+    // The symmetry is the innermost index to keep the 8 keys of one
+    // vertex in a single cache line.
+    using SymmetryKeys = std::array<std::uint64_t, NUM_SYMMETRIES>;
+    static std::array<std::array<SymmetryKeys, FastBoard::NUM_VERTICES>, 4> zobrist_sym;
+    static std::array<SymmetryKeys, FastBoard::NUM_VERTICES>                zobrist_ko_sym;
+
     static void init_zobrist(Random& rng);
 };
 
@@ -0,0 +1,75 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "config.h"
+
+#include <memory>
+
+#include "GTP.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+#include "Zobrist.h"
+
+// Same global setup as the unit tests, so benchmarks can use
+// everything from a board to a full GTP engine.
+static void init_global_objects() {
+    GTP::setup_default_parameters();
+    cfg_gtp_mode = true;
+    cfg_quiet = true;
+
+    thread_pool.initialize(cfg_num_threads);
+
+    // Use deterministic random numbers for hashing
+    auto rng = std::make_unique<Random>(5489);
+    Zobrist::init_zobrist(*rng);
+
+    Random::get_Rng().seedrandom(cfg_rng_seed);
+
+    cfg_weightsfile = "../src/tests/0k.txt";
+
+    auto playouts = std::min(cfg_max_playouts, cfg_max_visits);
+    auto network = std::make_unique<Network>();
+    network->initialize(playouts, cfg_weightsfile);
+    GTP::initialize(std::move(network));
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    init_global_objects();
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
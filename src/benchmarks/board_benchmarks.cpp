@@ -0,0 +1,257 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "config.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "FastBoard.h"
+#include "FastState.h"
+#include "FullBoard.h"
+#include "GameState.h"
+#include "Network.h"
+#include "Random.h"
+
+// Fixed so that every run measures the same games.
+static constexpr std::uint64_t GAMES_SEED = 5489;
+static constexpr auto NUM_GAMES = 8;
+static constexpr auto MAX_GAME_LENGTH = 2 * NUM_INTERSECTIONS;
+
+struct BenchmarkGames {
+    GameState start;
+    std::vector<std::vector<int>> moves;
+    // Positions along the games, every 50 moves.
+    std::vector<GameState> positions;
+    std::vector<GameState> final_positions;
+};
+
+// Random game that doesn't fill its own eyes, so it ends
+// with both sides passing.
+static std::vector<int> random_game(GameState& state, Random& rng,
+                                    std::vector<GameState>& positions) {
+    auto moves = std::vector<int>{};
+    auto legal = std::vector<int>{};
+
+    while (state.get_passes() < 2 && moves.size() < MAX_GAME_LENGTH) {
+        const auto color = state.get_to_move();
+        legal.clear();
+        for (auto vertex = 0; vertex < FastBoard::NUM_VERTICES; vertex++) {
+            if (state.board.get_state(vertex) == FastBoard::EMPTY
+                && state.is_move_legal(color, vertex)
+                && !state.board.is_eye(color, vertex)) {
+                legal.emplace_back(vertex);
+            }
+        }
+        auto move = int{FastBoard::PASS};
+        if (!legal.empty()) {
+            move = legal[rng.randuint64(legal.size())];
+        }
+        state.play_move(move);
+        moves.emplace_back(move);
+
+        if (moves.size() % 50 == 0) {
+            positions.emplace_back(state);
+        }
+    }
+    return moves;
+}
+
+static const BenchmarkGames& get_games() {
+    static const auto games = [] {
+        BenchmarkGames result;
+        result.start.init_game(BOARD_SIZE, KOMI);
+
+        auto rng = Random{GAMES_SEED};
+        for (auto i = 0; i < NUM_GAMES; i++) {
+            auto state = result.start;
+            result.moves.emplace_back(
+                random_game(state, rng, result.positions));
+            result.final_positions.emplace_back(state);
+        }
+        return result;
+    }();
+    return games;
+}
+
+static void BM_UpdateBoard(benchmark::State& bm) {
+    const auto& games = get_games();
+    auto moves = std::int64_t{0};
+
+    for (auto _ : bm) {
+        for (const auto& game : games.moves) {
+            auto board = games.start.board;
+            auto color = games.start.get_to_move();
+            for (const auto move : game) {
+                if (move != FastBoard::PASS) {
+                    board.update_board(color, move);
+                }
+                color = !color;
+            }
+            moves += game.size();
+            benchmark::DoNotOptimize(board.get_hash());
+        }
+    }
+    bm.SetItemsProcessed(moves);
+}
+BENCHMARK(BM_UpdateBoard);
+
+// Count the positions two plies deep, making and taking back moves.
+static void BM_Perft2(benchmark::State& bm) {
+    const auto& games = get_games();
+    auto leaves = std::int64_t{0};
+
+    for (auto _ : bm) {
+        for (const auto& position : games.positions) {
+            auto state = FastState{position};
+            auto undo1 = FastState::MoveUndo{};
+            auto undo2 = FastState::MoveUndo{};
+            for (auto m1 = 0; m1 < FastBoard::NUM_VERTICES; m1++) {
+                if (state.board.get_state(m1) != FastBoard::EMPTY
+                    || !state.is_move_legal(state.get_to_move(), m1)) {
+                    continue;
+                }
+                state.play_move(m1, undo1);
+                for (auto m2 = 0; m2 < FastBoard::NUM_VERTICES; m2++) {
+                    if (state.board.get_state(m2) != FastBoard::EMPTY
+                        || !state.is_move_legal(state.get_to_move(), m2)) {
+                        continue;
+                    }
+                    state.play_move(m2, undo2);
+                    leaves++;
+                    state.unplay_move(undo2);
+                }
+                state.unplay_move(undo1);
+            }
+        }
+    }
+    bm.SetItemsProcessed(leaves);
+}
+BENCHMARK(BM_Perft2)->Unit(benchmark::kMillisecond);
+
+static void BM_IsMoveLegal(benchmark::State& bm) {
+    const auto& games = get_games();
+    auto checks = std::int64_t{0};
+
+    for (auto _ : bm) {
+        auto legal = 0;
+        for (const auto& position : games.positions) {
+            const auto color = position.get_to_move();
+            for (auto vertex = 0; vertex < FastBoard::NUM_VERTICES; vertex++) {
+                if (position.board.get_state(vertex) == FastBoard::EMPTY) {
+                    legal += position.is_move_legal(color, vertex);
+                    checks++;
+                }
+            }
+        }
+        benchmark::DoNotOptimize(legal);
+    }
+    bm.SetItemsProcessed(checks);
+}
+BENCHMARK(BM_IsMoveLegal);
+
+static void BM_AreaScore(benchmark::State& bm) {
+    const auto& games = get_games();
+    auto scores = std::int64_t{0};
+
+    for (auto _ : bm) {
+        for (const auto& position : games.final_positions) {
+            benchmark::DoNotOptimize(position.board.area_score(KOMI));
+            scores++;
+        }
+    }
+    bm.SetItemsProcessed(scores);
+}
+BENCHMARK(BM_AreaScore);
+
+static void BM_CalcSymmetryHash(benchmark::State& bm) {
+    const auto& games = get_games();
+    auto hashes = std::int64_t{0};
+
+    for (auto _ : bm) {
+        for (const auto& position : games.positions) {
+            for (auto sym = 0; sym < Network::NUM_SYMMETRIES; sym++) {
+                benchmark::DoNotOptimize(
+                    position.board.calc_symmetry_hash(position.m_komove, sym));
+                hashes++;
+            }
+        }
+    }
+    bm.SetItemsProcessed(hashes);
+}
+BENCHMARK(BM_CalcSymmetryHash);
+
+static void BM_GetSymmetryHash(benchmark::State& bm) {
+    const auto& games = get_games();
+    auto hashes = std::int64_t{0};
+
+    for (auto _ : bm) {
+        for (const auto& position : games.positions) {
+            for (auto sym = 0; sym < Network::NUM_SYMMETRIES; sym++) {
+                benchmark::DoNotOptimize(position.get_symmetry_hash(sym));
+                hashes++;
+            }
+        }
+    }
+    bm.SetItemsProcessed(hashes);
+}
+BENCHMARK(BM_GetSymmetryHash);
+
+static void BM_GameStateCopy(benchmark::State& bm) {
+    const auto& games = get_games();
+    auto copies = std::int64_t{0};
+
+    for (auto _ : bm) {
+        for (const auto& position : games.positions) {
+            auto copy = GameState{position};
+            benchmark::DoNotOptimize(copy.board.get_hash());
+            copies++;
+        }
+    }
+    bm.SetItemsProcessed(copies);
+}
+BENCHMARK(BM_GameStateCopy);
+
+static void BM_GatherFeatures(benchmark::State& bm) {
+    const auto& games = get_games();
+    auto features = std::int64_t{0};
+
+    for (auto _ : bm) {
+        for (const auto& position : games.positions) {
+            const auto sym = features % Network::NUM_SYMMETRIES;
+            auto input = Network::gather_features(&position, sym);
+            benchmark::DoNotOptimize(input.data());
+            features++;
+        }
+    }
+    bm.SetItemsProcessed(features);
+}
+BENCHMARK(BM_GatherFeatures);
@@ -0,0 +1,128 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "config.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FastBoard.h"
+#include "GTP.h"
+#include "GameState.h"
+#include "Random.h"
+#include "Utils.h"
+
+static constexpr std::uint64_t TRANSCRIPT_SEED = 4321;
+static constexpr auto GAME_LENGTH = 200;
+// Queries a review client sends between moves, every so many moves.
+static constexpr auto QUERY_INTERVAL = 10;
+
+// What a batch review client sends to set up one game: numbered
+// commands, mostly play, with queries and an undo now and then.
+static const std::vector<std::string>& get_transcript() {
+    static const auto transcript = [] {
+        auto rng = Random{TRANSCRIPT_SEED};
+        auto state = GameState{};
+        state.init_game(BOARD_SIZE, KOMI);
+
+        auto lines = std::vector<std::string>{"clear_board", "komi 7.5"};
+        auto legal = std::vector<int>{};
+        for (auto i = 0; i < GAME_LENGTH; i++) {
+            const auto color = state.get_to_move();
+            legal.clear();
+            for (auto vertex = 0; vertex < FastBoard::NUM_VERTICES; vertex++) {
+                if (state.board.get_state(vertex) == FastBoard::EMPTY
+                    && state.is_move_legal(color, vertex)
+                    && !state.board.is_eye(color, vertex)) {
+                    legal.emplace_back(vertex);
+                }
+            }
+            if (legal.empty()) {
+                break;
+            }
+            const auto move = legal[rng.randuint64(legal.size())];
+            const auto play = std::to_string(i) + " play "
+                + (color == FastBoard::BLACK ? "b " : "w ")
+                + state.move_to_text(move);
+            state.play_move(move);
+
+            lines.emplace_back(play);
+            if (i % QUERY_INTERVAL == QUERY_INTERVAL - 1) {
+                lines.emplace_back("known_command lz-analyze");
+                lines.emplace_back("last_move");
+                lines.emplace_back("undo");
+                lines.emplace_back(play);
+                lines.emplace_back("final_score");
+            }
+        }
+        lines.emplace_back("move_history");
+        return lines;
+    }();
+    return transcript;
+}
+
+// Keeps the responses out of the measurement, but not their formatting.
+class NullChannel : public Utils::GTPChannel {
+public:
+    void write(const std::string& text) override {
+        m_bytes += text.size();
+    }
+    bool input_pending() override {
+        return false;
+    }
+    std::int64_t bytes() const {
+        return m_bytes;
+    }
+
+private:
+    std::int64_t m_bytes{0};
+};
+
+static void BM_GTPTranscript(benchmark::State& bm) {
+    const auto& transcript = get_transcript();
+    static auto game = GameState{};
+    game.init_game(BOARD_SIZE, KOMI);
+
+    auto channel = NullChannel{};
+    Utils::set_gtp_channel(&channel);
+    for (auto _ : bm) {
+        for (const auto& line : transcript) {
+            GTP::execute(game, line);
+        }
+    }
+    Utils::set_gtp_channel(nullptr);
+
+    bm.SetItemsProcessed(bm.iterations() * transcript.size());
+    bm.counters["response_bytes"] = benchmark::Counter(
+        channel.bytes(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_GTPTranscript)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,68 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "config.h"
+
+#include "FastBoard.h"
+#include "GTP.h"
+#include "GameState.h"
+#include "SearchScheduler.h"
+#include "UCTSearch.h"
+
+static constexpr auto SEARCH_PLAYOUTS = 400;
+
+// What every playout pays for scheduling, with the workers of one
+// search competing for it.
+static void BM_SchedulerSlot(benchmark::State& bm) {
+    static SearchScheduler::Client client;
+    for (auto _ : bm) {
+        SearchScheduler::Slot slot(client);
+        benchmark::ClobberMemory();
+    }
+    bm.SetItemsProcessed(bm.iterations());
+}
+BENCHMARK(BM_SchedulerSlot)->ThreadRange(1, 8)->UseRealTime();
+
+// Playouts per second of a whole search from the empty board. The
+// network results come from the cache after the first iteration, so
+// this measures the search itself.
+static void BM_SearchPlayouts(benchmark::State& bm) {
+    for (auto _ : bm) {
+        auto game = GameState{};
+        game.init_game(BOARD_SIZE, KOMI);
+        UCTSearch search(game, *GTP::s_network);
+        search.set_playout_limit(SEARCH_PLAYOUTS);
+        benchmark::DoNotOptimize(
+            search.think(FastBoard::BLACK, UCTSearch::NORESIGN));
+    }
+    bm.SetItemsProcessed(bm.iterations() * SEARCH_PLAYOUTS);
+}
+BENCHMARK(BM_SearchPlayouts)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,199 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "config.h"
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FastBoard.h"
+#include "GameState.h"
+#include "Random.h"
+#include "SGFParser.h"
+#include "SGFTree.h"
+
+static constexpr std::uint64_t SGF_SEED = 1234;
+static constexpr auto NUM_SGF_GAMES = 16;
+static constexpr auto GAME_LENGTH = 250;
+// Start a variation every so many moves, like a reviewed game.
+static constexpr auto VARIATION_INTERVAL = 40;
+
+// Random game written out with a comment on every move and nested
+// variations, so that there is plenty the main line parser can skip.
+static std::string random_sgf(Random& rng) {
+    auto state = GameState{};
+    state.init_game(BOARD_SIZE, KOMI);
+
+    auto sgf = std::string{"(;GM[1]FF[4]SZ[19]KM[0.5]RE[B+R]"
+                           "AB[dp][pd]AW[dd][pp]"};
+    auto closing = std::vector<std::string>{};
+    auto legal = std::vector<int>{};
+
+    for (auto i = 0; i < GAME_LENGTH; i++) {
+        const auto color = state.get_to_move();
+        legal.clear();
+        for (auto vertex = 0; vertex < FastBoard::NUM_VERTICES; vertex++) {
+            if (state.board.get_state(vertex) == FastBoard::EMPTY
+                && state.is_move_legal(color, vertex)
+                && !state.board.is_eye(color, vertex)) {
+                legal.emplace_back(vertex);
+            }
+        }
+        if (legal.empty()) {
+            break;
+        }
+        const auto move = legal[rng.randuint64(legal.size())];
+        const auto prop = std::string{color == FastBoard::BLACK ? "B" : "W"}
+            + "[" + state.board.move_to_text_sgf(move) + "]";
+        const auto comment = "C[move " + std::to_string(i + 1)
+            + ", winrate 50.0% \\] escaped, (not a variation)]";
+
+        if (i > 0 && i % VARIATION_INTERVAL == 0) {
+            sgf.append("(;" + prop + comment);
+            closing.emplace_back(")(;" + prop + "C[alternative])");
+        } else {
+            sgf.append(";" + prop + comment);
+        }
+        state.play_move(move);
+    }
+
+    for (auto it = closing.rbegin(); it != closing.rend(); ++it) {
+        sgf.append(*it);
+    }
+    sgf.append(")\n");
+    return sgf;
+}
+
+// Games as chop_next hands them to the parsers.
+static const std::vector<std::string>& get_sgf_games() {
+    static const auto games = [] {
+        auto rng = Random{SGF_SEED};
+        auto sgf = std::string{};
+        for (auto i = 0; i < NUM_SGF_GAMES; i++) {
+            sgf.append(random_sgf(rng));
+        }
+
+        auto result = std::vector<std::string>{};
+        auto ins = std::istringstream{sgf};
+        auto game = std::string{};
+        while (SGFParser::chop_next(ins, game)) {
+            result.emplace_back(game);
+        }
+        return result;
+    }();
+    return games;
+}
+
+static std::int64_t total_bytes(const std::vector<std::string>& games) {
+    auto bytes = std::int64_t{0};
+    for (const auto& game : games) {
+        bytes += game.size();
+    }
+    return bytes;
+}
+
+static void BM_ParseStream(benchmark::State& bm) {
+    const auto& games = get_sgf_games();
+
+    for (auto _ : bm) {
+        for (const auto& game : games) {
+            auto tree = SGFTree{};
+            auto strm = std::istringstream{game};
+            SGFParser::parse(strm, &tree);
+            benchmark::DoNotOptimize(&tree);
+        }
+    }
+    bm.SetBytesProcessed(bm.iterations() * total_bytes(games));
+}
+BENCHMARK(BM_ParseStream);
+
+static void BM_ParseMainline(benchmark::State& bm) {
+    const auto& games = get_sgf_games();
+
+    for (auto _ : bm) {
+        for (const auto& game : games) {
+            auto tree = SGFTree{};
+            SGFParser::parse_mainline(game.data(), game.data() + game.size(),
+                                      &tree);
+            benchmark::DoNotOptimize(&tree);
+        }
+    }
+    bm.SetBytesProcessed(bm.iterations() * total_bytes(games));
+}
+BENCHMARK(BM_ParseMainline);
+
+// Parsing and replaying the moves, as done for training data.
+static void BM_LoadFromString(benchmark::State& bm) {
+    const auto& games = get_sgf_games();
+
+    for (auto _ : bm) {
+        for (const auto& game : games) {
+            auto tree = SGFTree{};
+            tree.load_from_string(game);
+            benchmark::DoNotOptimize(tree.get_mainline().size());
+        }
+    }
+    bm.SetBytesProcessed(bm.iterations() * total_bytes(games));
+}
+BENCHMARK(BM_LoadFromString)->Unit(benchmark::kMillisecond);
+
+static void BM_LoadMainlineFromString(benchmark::State& bm) {
+    const auto& games = get_sgf_games();
+
+    for (auto _ : bm) {
+        for (const auto& game : games) {
+            auto tree = SGFTree{};
+            tree.load_mainline_from_string(game);
+            benchmark::DoNotOptimize(tree.get_mainline().size());
+        }
+    }
+    bm.SetBytesProcessed(bm.iterations() * total_bytes(games));
+}
+BENCHMARK(BM_LoadMainlineFromString)->Unit(benchmark::kMillisecond);
+
+// Full tree, but states are only computed for the main line.
+static void BM_LoadLazyFromString(benchmark::State& bm) {
+    const auto& games = get_sgf_games();
+
+    for (auto _ : bm) {
+        for (const auto& game : games) {
+            auto tree = SGFTree{};
+            tree.set_checkpoint_interval(SGFTree::DEFAULT_CHECKPOINT_INTERVAL);
+            tree.load_from_string(game);
+            benchmark::DoNotOptimize(
+                tree.follow_mainline_state().board.get_hash());
+        }
+    }
+    bm.SetBytesProcessed(bm.iterations() * total_bytes(games));
+}
+BENCHMARK(BM_LoadLazyFromString)->Unit(benchmark::kMillisecond);
@@ -32,17 +32,33 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <numeric>
 #include <regex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "BatchEvaluator.h"
 #include "GTP.h"
 #include "GameState.h"
 #include "NNCache.h"
+#include "NNCacheFile.h"
+#include "SGFParser.h"
+#include "SGFTree.h"
 #include "Random.h"
+#include "SearchBook.h"
+#include "SearchScheduler.h"
 #include "ThreadPool.h"
+#include "Training.h"
+#include "UCTSearch.h"
 #include "Utils.h"
 #include "Zobrist.h"
 
@@ -196,6 +212,778 @@ TEST_F(LeelaTest, KoPntNotSame) {
     EXPECT_NE(hash, maingame.board.get_hash());
 }
 
+TEST_F(LeelaTest, SymmetryHash) {
+    auto maingame = get_gamestate();
+    auto rotatedgame = get_gamestate();
+
+    testing::internal::CaptureStdout();
+    GTP::execute(maingame, "play b G8");
+    GTP::execute(maingame, "play w H8");
+    GTP::execute(maingame, "play b H7");
+    GTP::execute(maingame, "play w A1");
+    GTP::execute(maingame, "play b J8");
+    GTP::execute(maingame, "play w B1");
+    GTP::execute(maingame, "play b H9"); // capture
+
+    GTP::execute(rotatedgame, "play b N12");
+    GTP::execute(rotatedgame, "play w M12");
+    GTP::execute(rotatedgame, "play b M13");
+    GTP::execute(rotatedgame, "play w T19");
+    GTP::execute(rotatedgame, "play b L12");
+    GTP::execute(rotatedgame, "play w S19");
+    GTP::execute(rotatedgame, "play b M11"); // capture
+    std::string output = testing::internal::GetCapturedStdout();
+
+    // Incremental hashes must match the from-scratch calculation
+    for (auto sym = 0; sym < Zobrist::NUM_SYMMETRIES; sym++) {
+        EXPECT_EQ(maingame.get_symmetry_hash(sym),
+                  maingame.board.calc_symmetry_hash(maingame.m_komove, sym));
+    }
+    EXPECT_EQ(maingame.get_symmetry_hash(0),
+              maingame.board.calc_hash(maingame.m_komove));
+
+    // Rotating by 180 degrees is symmetry 3
+    EXPECT_EQ(maingame.get_symmetry_hash(3), rotatedgame.get_symmetry_hash(0));
+    EXPECT_NE(maingame.get_symmetry_hash(0), rotatedgame.get_symmetry_hash(0));
+}
+
+TEST_F(LeelaTest, CanonicalCache) {
+    auto maingame = get_gamestate();
+    auto rotatedgame = get_gamestate();
+
+    testing::internal::CaptureStdout();
+    GTP::execute(maingame, "play b G8");
+    GTP::execute(maingame, "play w H8");
+    GTP::execute(rotatedgame, "play b N12");
+    GTP::execute(rotatedgame, "play w M12");
+    std::string output = testing::internal::GetCapturedStdout();
+
+    cfg_canonical_cache = true;
+    GTP::s_network->nncache_clear();
+
+    auto result = GTP::s_network->get_output(&maingame,
+                                             Network::Ensemble::DIRECT,
+                                             Network::IDENTITY_SYMMETRY);
+    auto rotated = GTP::s_network->get_output(&rotatedgame,
+                                              Network::Ensemble::DIRECT,
+                                              Network::IDENTITY_SYMMETRY,
+                                              true, false);
+    cfg_canonical_cache = false;
+
+    // The rotated position is served from the cache, with the policy
+    // rotated by 180 degrees.
+    EXPECT_EQ(result.winrate, rotated.winrate);
+    EXPECT_EQ(result.policy_pass, rotated.policy_pass);
+    for (auto idx = 0; idx < NUM_INTERSECTIONS; idx++) {
+        EXPECT_EQ(result.policy[idx],
+                  rotated.policy[NUM_INTERSECTIONS - 1 - idx]);
+    }
+}
+
+static void expect_same_state(const FastState& state, const FastState& ref) {
+    EXPECT_EQ(state.board.get_hash(), ref.board.get_hash());
+    EXPECT_EQ(state.board.get_ko_hash(), ref.board.get_ko_hash());
+    for (auto sym = 0; sym < Zobrist::NUM_SYMMETRIES; sym++) {
+        EXPECT_EQ(state.get_symmetry_hash(sym), ref.get_symmetry_hash(sym));
+    }
+    EXPECT_EQ(state.get_to_move(), ref.get_to_move());
+    EXPECT_EQ(state.get_passes(), ref.get_passes());
+    EXPECT_EQ(state.get_movenum(), ref.get_movenum());
+    EXPECT_EQ(state.get_last_move(), ref.get_last_move());
+    EXPECT_EQ(state.m_komove, ref.m_komove);
+    for (auto color : {FastBoard::BLACK, FastBoard::WHITE}) {
+        EXPECT_EQ(state.board.get_prisoners(color),
+                  ref.board.get_prisoners(color));
+    }
+    const auto size = ref.board.get_boardsize();
+    for (auto vertex = 0; vertex < FastBoard::NUM_VERTICES; vertex++) {
+        const auto xy = std::make_pair(vertex % (size + 2) - 1,
+                                       vertex / (size + 2) - 1);
+        if (xy.first < 0 || xy.first >= size
+            || xy.second < 0 || xy.second >= size) {
+            continue;
+        }
+        const auto color = ref.board.get_state(vertex);
+        ASSERT_EQ(state.board.get_state(vertex), color);
+        if (color == FastBoard::EMPTY) {
+            EXPECT_EQ(state.board.is_suicide(vertex, FastBoard::BLACK),
+                      ref.board.is_suicide(vertex, FastBoard::BLACK));
+            EXPECT_EQ(state.board.is_suicide(vertex, FastBoard::WHITE),
+                      ref.board.is_suicide(vertex, FastBoard::WHITE));
+        } else {
+            EXPECT_EQ(state.board.get_string(vertex),
+                      ref.board.get_string(vertex));
+        }
+    }
+}
+
+TEST_F(LeelaTest, UnplayMove) {
+    auto rng = Random{1234};
+
+    for (auto game = 0; game < 2; game++) {
+        auto state = FastState{get_gamestate()};
+        auto history = std::vector<FastState>{};
+        auto undos = std::vector<FastState::MoveUndo>{};
+
+        while (state.get_passes() < 2 && history.size() < 400) {
+            auto moves = std::vector<int>{};
+            for (auto vertex = 0; vertex < FastBoard::NUM_VERTICES; vertex++) {
+                if (state.board.get_state(vertex) == FastBoard::EMPTY
+                    && state.is_move_legal(state.get_to_move(), vertex)) {
+                    moves.emplace_back(vertex);
+                }
+            }
+            if (moves.empty() || rng.randfix<50>() == 0) {
+                moves = {FastBoard::PASS};
+            }
+            history.emplace_back(state);
+            undos.emplace_back();
+            state.play_move(moves[rng.randuint64(moves.size())],
+                            undos.back());
+        }
+
+        while (!history.empty()) {
+            state.unplay_move(undos.back());
+            expect_same_state(state, history.back());
+            undos.pop_back();
+            history.pop_back();
+        }
+    }
+
+    // Suicide is handled by the board even if play_move doesn't allow it.
+    auto state = FastState{get_gamestate()};
+    auto undo = FullBoard::MoveUndo{};
+    state.board.update_board(FastBoard::WHITE, state.board.get_vertex(0, 1));
+    state.board.update_board(FastBoard::WHITE, state.board.get_vertex(1, 0));
+    const auto before_suicide = state;
+    state.board.update_board(FastBoard::BLACK, state.board.get_vertex(0, 0),
+                             &undo);
+    EXPECT_EQ(state.board.get_state(0, 0), FastBoard::EMPTY);
+    state.board.unplay_move(undo);
+    expect_same_state(state, before_suicide);
+}
+
+TEST_F(LeelaTest, TrainingRecordFormats) {
+    auto rng = Random{1234};
+    auto record = TrainingRecord{};
+    for (auto& plane : record.planes) {
+        for (auto idx = size_t{0}; idx < plane.size(); idx++) {
+            plane[idx] = rng.randfix<2>();
+        }
+    }
+    record.probabilities[rng.randfix<POTENTIAL_MOVES>()] = 0.25f;
+    record.probabilities[NUM_INTERSECTIONS] = 0.75f;
+    record.to_move = FastBoard::WHITE;
+    record.winner = true;
+
+    // text -> record -> binary -> record
+    auto text = std::stringstream{};
+    record.write_text(text);
+    auto from_text = TrainingRecord{};
+    EXPECT_TRUE(from_text.read_text(text));
+
+    auto binary = std::string{};
+    from_text.write_binary(binary);
+    EXPECT_EQ(binary.size(), TrainingRecord::BINARY_SIZE);
+    auto from_binary = TrainingRecord{};
+    from_binary.read_binary(binary.data());
+
+    EXPECT_EQ(from_binary.planes, record.planes);
+    EXPECT_EQ(from_binary.probabilities, record.probabilities);
+    EXPECT_EQ(from_binary.to_move, record.to_move);
+    EXPECT_EQ(from_binary.winner, record.winner);
+
+    auto bad_text = std::stringstream{"not a training chunk\n"};
+    EXPECT_FALSE(from_text.read_text(bad_text));
+}
+
+TEST_F(LeelaTest, TrainingRecordSymmetries) {
+    auto& state = get_gamestate();
+    state.play_textmove("b", "d4");
+    state.play_textmove("w", "q3");
+    state.play_textmove("b", "c16");
+
+    // put the policy on the stones of the side to move, so that it
+    // can be checked against the planes in every orientation
+    auto record = TrainingRecord{};
+    const auto identity =
+        Network::gather_features(&state, Network::IDENTITY_SYMMETRY);
+    for (auto c = size_t{0}; c < TrainingRecord::INPUT_PLANES; c++) {
+        for (auto idx = 0; idx < NUM_INTERSECTIONS; idx++) {
+            record.planes[c][idx] = bool(identity[c * NUM_INTERSECTIONS + idx]);
+        }
+    }
+    for (auto idx = 0; idx < NUM_INTERSECTIONS; idx++) {
+        record.probabilities[idx] = record.planes[0][idx] ? 0.125f : 0.0f;
+    }
+    record.probabilities[NUM_INTERSECTIONS] = 0.25f;
+    record.to_move = state.get_to_move();
+    record.winner = true;
+
+    auto symmetries = std::vector<int>(Network::NUM_SYMMETRIES);
+    std::iota(begin(symmetries), end(symmetries), 0);
+    const auto oriented = record.transform(symmetries);
+    ASSERT_EQ(oriented.size(), size_t(Network::NUM_SYMMETRIES));
+
+    for (const auto symmetry : symmetries) {
+        const auto& result = oriented[symmetry];
+        // same as feeding the network that orientation
+        const auto features = Network::gather_features(&state, symmetry);
+        for (auto c = size_t{0}; c < TrainingRecord::INPUT_PLANES; c++) {
+            for (auto idx = 0; idx < NUM_INTERSECTIONS; idx++) {
+                EXPECT_EQ(result.planes[c][idx],
+                          bool(features[c * NUM_INTERSECTIONS + idx]));
+            }
+        }
+        for (auto idx = 0; idx < NUM_INTERSECTIONS; idx++) {
+            EXPECT_EQ(result.probabilities[idx],
+                      result.planes[0][idx] ? 0.125f : 0.0f);
+        }
+        EXPECT_EQ(result.probabilities[NUM_INTERSECTIONS], 0.25f);
+        EXPECT_EQ(result.to_move, record.to_move);
+        EXPECT_EQ(result.winner, record.winner);
+    }
+}
+
+TEST_F(LeelaTest, RandomSymmetriesKeepSplit) {
+    // A few searched positions, as self-play leaves them.
+    cfg_max_playouts = 5;
+    Training::clear_training();
+    auto& state = get_gamestate();
+    {
+        auto search = std::make_unique<UCTSearch>(state, *GTP::s_network);
+        for (auto i = 0; i < 3; i++) {
+            state.play_move(search->think(state.get_to_move()));
+        }
+    }
+
+    cfg_training_symmetries = training_symmetry_t::RANDOM;
+    cfg_validation_split = 0.5f;
+    const auto basename = std::string{"symmetry_split_test"};
+    const auto dump = [&] {
+        Training::dump_training(FastBoard::BLACK, basename);
+        OutputChunker::wait_for_writes();
+        auto chunks = std::vector<std::string>{};
+        for (const auto& name : {basename + ".0.gz", basename + "_val.0.gz"}) {
+            auto records = std::vector<TrainingRecord>{};
+            if (std::ifstream{name}.good()) {
+                records = Training::read_chunk(name);
+                std::remove(name.c_str());
+            }
+            auto planes = std::string{};
+            for (const auto& record : records) {
+                for (const auto& plane : record.planes) {
+                    planes += plane.to_string();
+                }
+            }
+            chunks.emplace_back(planes);
+        }
+        return chunks;
+    };
+
+    const auto first = dump();
+    // other games draw from the shared generator in between
+    for (auto i = 0; i < 7; i++) {
+        Random::get_Rng().randuint64();
+    }
+    const auto second = dump();
+    EXPECT_EQ(first, second);
+    EXPECT_NE(first[0].empty(), first[1].empty());
+    Training::clear_training();
+}
+
+static std::vector<std::string> read_lines(const std::string& filename) {
+    auto in = std::ifstream{filename};
+    auto lines = std::vector<std::string>{};
+    for (auto line = std::string{}; std::getline(in, line);) {
+        lines.emplace_back(line);
+    }
+    return lines;
+}
+
+TEST_F(LeelaTest, ChunkerShuffleSplit) {
+    const auto basename = std::string{"chunker_test"};
+    const auto val_name = basename + "_val";
+    const auto write_games = [&] {
+        std::remove(basename.c_str());
+        std::remove(val_name.c_str());
+        auto chunker = OutputChunker{basename};
+        for (auto game = 0; game < 40; game++) {
+            auto positions = std::vector<std::string>{};
+            for (auto move = 0; move < 10; move++) {
+                positions.emplace_back(std::to_string(game) + " "
+                                       + std::to_string(move) + "\n");
+            }
+            chunker.append_game(positions);
+        }
+    };
+
+    cfg_shuffle_positions = 50;
+    cfg_validation_split = 0.25f;
+    write_games();
+    const auto train = read_lines(basename);
+    const auto validation = read_lines(val_name);
+    write_games();
+    const auto validation_again = read_lines(val_name);
+    std::remove(basename.c_str());
+    std::remove(val_name.c_str());
+
+    EXPECT_EQ(train.size() + validation.size(), 400);
+    EXPECT_FALSE(validation.empty());
+    // not in game order any more
+    auto in_order = train;
+    std::sort(begin(in_order), end(in_order),
+              [](const std::string& a, const std::string& b) {
+                  auto a_game = 0, a_move = 0, b_game = 0, b_move = 0;
+                  std::istringstream{a} >> a_game >> a_move;
+                  std::istringstream{b} >> b_game >> b_move;
+                  return std::make_pair(a_game, a_move)
+                         < std::make_pair(b_game, b_move);
+              });
+    EXPECT_NE(train, in_order);
+
+    // every game is whole on one side of the split, on every run
+    const auto game_of = [](const std::string& line) {
+        return line.substr(0, line.find(' '));
+    };
+    auto train_games = std::vector<std::string>{};
+    std::transform(begin(train), end(train),
+                   std::back_inserter(train_games), game_of);
+    for (const auto& line : validation) {
+        EXPECT_EQ(std::count(begin(train_games), end(train_games),
+                             game_of(line)), 0);
+    }
+    auto sorted = validation;
+    auto sorted_again = validation_again;
+    std::sort(begin(sorted), end(sorted));
+    std::sort(begin(sorted_again), end(sorted_again));
+    EXPECT_EQ(sorted, sorted_again);
+}
+
+TEST_F(LeelaTest, ChopNextGame) {
+    auto sgf = std::istringstream{
+        "(;GM[1]SZ[19];B[aa];W[bb])\n"
+        "(;GM[1]SZ[19]C[escaped \\] (paren)];B[cc])\n"};
+    auto game = std::string{};
+
+    EXPECT_TRUE(SGFParser::chop_next(sgf, game));
+    EXPECT_EQ(game, "GM[1]SZ[19];B[aa];W[bb])");
+    EXPECT_TRUE(SGFParser::chop_next(sgf, game));
+    EXPECT_EQ(game, "GM[1]SZ[19]C[escaped \\] (paren)];B[cc])");
+    EXPECT_FALSE(SGFParser::chop_next(sgf, game));
+}
+
+TEST_F(LeelaTest, ParseMainline) {
+    const auto sgf = std::string{
+        "GM[1]FF[4]SZ[19]KM[0.5]RE[W+R]AB[dp][pd]AW[dd][pp]"
+        "C[root \\] comment (not a variation)]"
+        ";W[cc]C[first]\n;B[ee]"
+        "(;W[gg] C[main] LB[aa:x];B[hh])"
+        "(;W[qq];B[rr](;W[ss])(;W[pq]))"
+        ";W[ab])"};
+
+    auto full = SGFTree{};
+    full.load_from_string(sgf);
+    auto mainline = SGFTree{};
+    mainline.load_mainline_from_string(sgf);
+
+    EXPECT_EQ(mainline.get_mainline(), full.get_mainline());
+    EXPECT_EQ(mainline.get_mainline().size(), 4);
+    EXPECT_EQ(mainline.get_winner(), full.get_winner());
+    EXPECT_EQ(mainline.get_child(1), nullptr);
+    EXPECT_EQ(mainline.follow_mainline_state().board.get_hash(),
+              full.follow_mainline_state().board.get_hash());
+}
+
+static void expect_same_states(const SGFTree* eager, const SGFTree* lazy) {
+    EXPECT_EQ(lazy->get_state()->board.get_hash(),
+              eager->get_state()->board.get_hash());
+    EXPECT_EQ(lazy->get_state()->get_to_move(),
+              eager->get_state()->get_to_move());
+    EXPECT_EQ(lazy->get_state()->get_movenum(),
+              eager->get_state()->get_movenum());
+    for (auto i = size_t{0}; eager->get_child(i) != nullptr; i++) {
+        ASSERT_NE(lazy->get_child(i), nullptr);
+        expect_same_states(eager->get_child(i), lazy->get_child(i));
+    }
+}
+
+TEST_F(LeelaTest, LazySGFStates) {
+    const auto sgf = std::string{
+        "GM[1]FF[4]SZ[19]KM[0.5]RE[W+R]AB[dp][pd]AW[dd][pp]"
+        ";W[cc];B[ee](;W[gg];B[hh];W[ii];B[jj];W[kk])"
+        "(;W[qq];B[rr](;W[ss];B[tt];W[aa])(;W[pq];PL[W]))"
+        "(;W[ab];B[ac];W[ad];B[ae])"};
+
+    auto eager = SGFTree{};
+    eager.load_from_string(sgf);
+    auto lazy = SGFTree{};
+    lazy.set_checkpoint_interval(2);
+    lazy.load_from_string(sgf);
+
+    // the end of the main line first, so that later lookups can start
+    // from the checkpoints it left behind
+    const auto* leaf = &lazy;
+    while (leaf->get_child(0) != nullptr) {
+        leaf = leaf->get_child(0);
+    }
+    EXPECT_EQ(leaf->get_state()->board.get_hash(),
+              eager.follow_mainline_state().board.get_hash());
+    EXPECT_EQ(lazy.get_mainline(), eager.get_mainline());
+    expect_same_states(&eager, &lazy);
+
+    auto fresh = SGFTree{};
+    fresh.set_checkpoint_interval(3);
+    fresh.load_from_string(sgf);
+    EXPECT_EQ(fresh.follow_mainline_state().board.get_hash(),
+              eager.follow_mainline_state().board.get_hash());
+}
+
+TEST_F(LeelaTest, SGFIndex) {
+    const auto filename = std::string{"sgfindex_test.sgf"};
+    const auto idx_filename = filename + ".idx";
+    std::remove(idx_filename.c_str());
+    {
+        auto out = std::ofstream{filename};
+        for (auto i = 0; i < 5; i++) {
+            out << "(;GM[1]SZ[19]C[game " << i << " (\\)];W[cc])\n";
+        }
+    }
+
+    const auto games = SGFParser::chop_all(filename);
+    ASSERT_EQ(games.size(), 5);
+    EXPECT_EQ(SGFParser::chop_from_file(filename, 3), games[3]);
+    EXPECT_TRUE(std::ifstream{idx_filename}.good());
+    // second lookup goes through the index
+    EXPECT_EQ(SGFParser::chop_from_file(filename, 4), games[4]);
+    EXPECT_EQ(SGFParser::chop_from_file(filename, 1), games[1]);
+    EXPECT_THROW(SGFParser::chop_from_file(filename, 5), std::runtime_error);
+
+    // a changed file invalidates the index
+    {
+        auto out = std::ofstream{filename, std::ofstream::app};
+        out << "(;GM[1]SZ[19];W[dd])\n";
+    }
+    EXPECT_EQ(SGFParser::chop_from_file(filename, 5), "GM[1]SZ[19];W[dd])");
+    EXPECT_EQ(SGFParser::chop_from_file(filename, 2), games[2]);
+
+    std::remove(filename.c_str());
+    std::remove(idx_filename.c_str());
+}
+
+TEST_F(LeelaTest, BatchEvaluatorPositions) {
+    const auto sgf_filename = std::string{"evaluate_test.sgf"};
+    const auto positions_filename = std::string{"evaluate_test.txt"};
+    const auto out_filename = std::string{"evaluate_test.bin"};
+    {
+        auto out = std::ofstream{sgf_filename};
+        for (auto i = 0; i < 3; i++) {
+            out << "(;GM[1]SZ[19];B[dd];W[pp];B[dp])\n";
+        }
+    }
+    {
+        auto out = std::ofstream{positions_filename};
+        out << "2:1\n\n1:3\n2:0\n2:1\n";
+    }
+    const auto record_size = 12 + 4 * (NUM_INTERSECTIONS + 1);
+    const auto read_output = [&] {
+        auto in = std::ifstream{out_filename, std::ifstream::binary};
+        return std::string{std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>()};
+    };
+
+    // every position of every game
+    EXPECT_EQ(BatchEvaluator::run(*GTP::s_network, sgf_filename,
+                                  out_filename, 2), 12u);
+    EXPECT_EQ(read_output().size(), 8u + 12 * record_size);
+
+    // or just those picked, each once
+    const auto selection = BatchEvaluator::read_selection(positions_filename);
+    ASSERT_EQ(BatchEvaluator::run(*GTP::s_network, sgf_filename,
+                                  out_filename, 1, selection), 3u);
+    const auto output = read_output();
+    ASSERT_EQ(output.size(), 8u + 3 * record_size);
+    EXPECT_EQ(output.substr(0, 8), BatchEvaluator::MAGIC);
+    // game 1 at move 3, white to move, little endian
+    const auto record = output.substr(8, 8);
+    EXPECT_EQ(record, std::string("\x01\0\0\0\x03\0\x01\0", 8));
+
+    {
+        auto out = std::ofstream{positions_filename};
+        out << "2 1\n";
+    }
+    EXPECT_THROW(BatchEvaluator::read_selection(positions_filename),
+                 std::runtime_error);
+
+    std::remove(sgf_filename.c_str());
+    std::remove(positions_filename.c_str());
+    std::remove(out_filename.c_str());
+}
+
+TEST_F(LeelaTest, NNCacheFile) {
+    const auto filename = std::string{"nncache_test.bin"};
+    std::remove(filename.c_str());
+
+    auto result = NNCache::Netresult{};
+    result.policy[42] = 0.5f;
+    result.winrate = 0.25f;
+    {
+        NNCache cache;
+        cache.attach_file(
+            std::make_unique<NNCacheFile>(filename, 100, 1, false));
+        cache.insert(12345, result, 3);
+    }
+
+    // a new process finds the result in the file
+    {
+        NNCache cache;
+        cache.attach_file(
+            std::make_unique<NNCacheFile>(filename, 100, 1, true));
+        auto found = NNCache::Netresult{};
+        auto symmetry = 0;
+        ASSERT_TRUE(cache.lookup(12345, found, symmetry));
+        EXPECT_EQ(found.policy[42], 0.5f);
+        EXPECT_EQ(found.winrate, 0.25f);
+        EXPECT_EQ(symmetry, 3);
+        EXPECT_FALSE(cache.lookup(54321, found));
+    }
+
+    // results of another network are not shared
+    EXPECT_THROW(NNCacheFile(filename, 100, 2, true), std::runtime_error);
+    {
+        // and replacing the file leaves its readers alone
+        NNCacheFile old_file{filename, 100, 1, true};
+        NNCacheFile file{filename, 100, 2, false};
+        auto found = NNCache::Netresult{};
+        auto symmetry = 0;
+        EXPECT_FALSE(file.lookup(12345, found, symmetry));
+        EXPECT_TRUE(old_file.lookup(12345, found, symmetry));
+    }
+    std::remove(filename.c_str());
+
+    // a file sized for a budget stays within it
+    const auto budget = size_t{64 * 1024};
+    const auto entries = NNCacheFile::entries_for_bytes(budget);
+    EXPECT_GT(entries, 0u);
+    EXPECT_EQ(NNCacheFile::entries_for_bytes(0), 0u);
+    {
+        NNCacheFile file{filename, entries, 1, false};
+        EXPECT_EQ(file.get_entry_count(), entries);
+    }
+    {
+        auto in = std::ifstream{filename, std::ifstream::binary};
+        in.seekg(0, std::ios::end);
+        EXPECT_LE(size_t(in.tellg()), budget);
+    }
+
+    std::remove(filename.c_str());
+}
+
+TEST_F(LeelaTest, NNCacheFileNoTornReads) {
+    const auto filename = std::string{"nncache_torn_test.bin"};
+    std::remove(filename.c_str());
+
+    // Two positions fighting over a single slot.
+    NNCacheFile writer{filename, 1, 1, false};
+    NNCacheFile reader{filename, 1, 1, true};
+    std::atomic<bool> done{false};
+    auto writes = std::thread([&] {
+        auto result = NNCache::Netresult{};
+        for (auto i = 0; i < 100'000; i++) {
+            std::fill(begin(result.policy), end(result.policy), float(i));
+            result.policy_pass = result.winrate = float(i);
+            writer.insert(1 + i % 2, result, i % 8);
+        }
+        done = true;
+    });
+
+    auto torn = 0;
+    auto found = NNCache::Netresult{};
+    auto symmetry = 0;
+    while (!done) {
+        for (auto hash = 1; hash <= 2; hash++) {
+            if (reader.lookup(hash, found, symmetry)) {
+                const auto value = found.winrate;
+                torn += found.policy_pass != value
+                    || symmetry != int(value) % 8
+                    || int(value) % 2 != hash - 1
+                    || std::any_of(begin(found.policy), end(found.policy),
+                                   [&](float p) { return p != value; });
+            }
+        }
+    }
+    writes.join();
+    EXPECT_EQ(torn, 0);
+
+    std::remove(filename.c_str());
+}
+
+TEST_F(LeelaTest, SearchBook) {
+    const auto filename = std::string{"searchbook_test.bin"};
+    auto& book = SearchBook::get();
+    book.clear();
+    cfg_book_file = filename;
+    cfg_book_update = true;
+    cfg_book_min_visits = 10;
+    cfg_max_playouts = 20;
+
+    auto& state = get_gamestate();
+    const auto color = state.get_to_move();
+    {
+        auto search = std::make_unique<UCTSearch>(state, *GTP::s_network);
+        search->think(color);
+    }
+    ASSERT_EQ(book.size(), 1);
+
+    book.save(filename);
+    EXPECT_FALSE(std::ifstream{filename + ".tmp"});
+    book.clear();
+    book.load(filename);
+    auto book_move = SearchBook::Move{};
+    ASSERT_TRUE(book.best_move(state, true, book_move));
+    EXPECT_GE(book_move.visits, 1);
+
+    // komi is part of the position
+    {
+        auto other_komi = state;
+        other_komi.set_komi(6.5f);
+        auto other_move = SearchBook::Move{};
+        EXPECT_FALSE(book.best_move(other_komi, true, other_move));
+    }
+
+    // the next game plays the book move without searching
+    {
+        auto search = std::make_unique<UCTSearch>(state, *GTP::s_network);
+        EXPECT_EQ(search->think(color), book_move.move);
+        expect_regex(search->explain_last_think(), "\\(book\\)");
+    }
+
+    // and still tells analysis clients about it
+    {
+        auto cmdstream = std::istringstream{"50"};
+        cfg_analyze_tags = AnalyzeTags{cmdstream, state};
+        auto search = std::make_unique<UCTSearch>(state, *GTP::s_network);
+        testing::internal::CaptureStdout();
+        search->think(color);
+        const auto output = testing::internal::GetCapturedStdout();
+        cfg_analyze_tags = AnalyzeTags{};
+        expect_regex(output, "^info move " + state.move_to_text(book_move.move)
+                     + " visits " + std::to_string(book_move.visits) + " ");
+    }
+
+    // too shallow searches and later moves are not used
+    cfg_book_min_visits = 100;
+    EXPECT_FALSE(book.best_move(state, true, book_move));
+    cfg_book_min_visits = 10;
+    cfg_book_depth = 0;
+    EXPECT_FALSE(book.best_move(state, true, book_move));
+
+    book.clear();
+    std::remove(filename.c_str());
+}
+
+TEST_F(LeelaTest, SearchTreeFile) {
+    const auto filename = std::string{"searchtree_test.bin"};
+    cfg_max_playouts = 30;
+
+    auto& state = get_gamestate();
+    auto visits = 0;
+    {
+        auto search = std::make_unique<UCTSearch>(state, *GTP::s_network);
+        search->think(state.get_to_move());
+        visits = search->save_tree(filename);
+    }
+    EXPECT_GE(visits, 30);
+
+    // the same bytes on every platform: magic, then a little endian
+    // version
+    {
+        auto in = std::ifstream{filename, std::ifstream::binary};
+        auto header = std::string(12, '\0');
+        ASSERT_TRUE(in.read(&header[0], header.size()));
+        EXPECT_EQ(header, std::string("LZTREE01\x02\0\0\0", 12));
+    }
+
+    // corrupt files are refused, not trusted
+    {
+        auto in = std::ifstream{filename, std::ifstream::binary};
+        const auto saved = std::string{std::istreambuf_iterator<char>(in),
+                                       std::istreambuf_iterator<char>()};
+        // header, then the root's statistics before its child count
+        const auto children_offset = 32 + 25;
+        const auto move_offset = children_offset + 4 + 1;
+        for (const auto& patch :
+                 {std::make_pair(children_offset, std::string(4, '\xFF')),
+                  std::make_pair(move_offset, std::string("\x00\x7F", 2))}) {
+            auto corrupt = saved;
+            corrupt.replace(patch.first, patch.second.size(), patch.second);
+            const auto corrupt_filename = filename + ".corrupt";
+            std::ofstream(corrupt_filename, std::ofstream::binary) << corrupt;
+            auto search = std::make_unique<UCTSearch>(state, *GTP::s_network);
+            EXPECT_THROW(search->load_tree(corrupt_filename),
+                         std::runtime_error);
+            std::remove(corrupt_filename.c_str());
+        }
+    }
+
+    // a new search continues from the restored tree
+    {
+        auto search = std::make_unique<UCTSearch>(state, *GTP::s_network);
+        EXPECT_EQ(search->load_tree(filename), visits);
+        cfg_max_playouts = 1;
+        search->set_playout_limit(1);
+        search->think(state.get_to_move());
+        EXPECT_EQ(search->save_tree(filename), visits + 1);
+    }
+
+    // only for the position it was saved in
+    state.play_move(state.get_to_move(), FastBoard::PASS);
+    {
+        auto search = std::make_unique<UCTSearch>(state, *GTP::s_network);
+        EXPECT_THROW(search->load_tree(filename), std::runtime_error);
+    }
+
+    std::remove(filename.c_str());
+}
+
+TEST_F(LeelaTest, SearchSchedulerShares) {
+    // One slot, two searches with a few threads each that always have
+    // a playout waiting: the interactive one gets the larger share,
+    // but not all of it.
+    auto& scheduler = SearchScheduler::get();
+    scheduler.set_capacity(1);
+
+    SearchScheduler::Client interactive, background;
+    interactive.begin(SearchScheduler::INTERACTIVE);
+    background.begin(SearchScheduler::BACKGROUND);
+
+    constexpr auto total = 1000;
+    std::atomic<int> granted{0};
+    auto counts = std::vector<int>(2, 0);
+    auto players = std::vector<std::thread>{};
+    for (auto i = 0; i < 6; i++) {
+        auto& client = i % 2 == 0 ? interactive : background;
+        players.emplace_back([&, i] {
+            while (granted < total) {
+                SearchScheduler::Slot slot(client);
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                granted++;
+                counts[i % 2]++;
+            }
+        });
+    }
+    for (auto& player : players) {
+        player.join();
+    }
+    interactive.end();
+    background.end();
+    scheduler.set_capacity(0);
+
+    EXPECT_GT(counts[0], 2 * counts[1]);
+    EXPECT_GT(counts[1], total / 20);
+    expect_regex(scheduler.report(), "search \\d+ idle \\d+ p/s [0-9.]+ ms wait");
+}
+
 TEST_F(LeelaTest, MoveOnOccupiedPnt) {
     auto maingame = get_gamestate();
     std::string output;
@@ -221,6 +1009,36 @@ TEST_F(LeelaTest, MoveOnOccupiedPnt) {
     EXPECT_NE(output.find("illegal move"), std::string::npos);
 }
 
+// Quitting is reported to the caller, however it is spelled.
+TEST_F(LeelaTest, QuitEndsInput) {
+    auto& maingame = get_gamestate();
+
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(GTP::execute(maingame, "name"));
+    EXPECT_TRUE(GTP::execute(maingame, "# quit"));
+    EXPECT_FALSE(GTP::execute(maingame, "QUIT"));
+    EXPECT_FALSE(GTP::execute(maingame, "7 Quit"));
+    EXPECT_FALSE(GTP::execute(maingame, "Exit\r"));
+    const auto output = testing::internal::GetCapturedStdout();
+
+    EXPECT_NE(output.find("=7 \n\n"), std::string::npos);
+}
+
+// Server sessions may not change what all sessions share.
+TEST_F(LeelaTest, ServerRefusesSharedCommands) {
+    cfg_server_port = 1;
+    const auto visits = cfg_max_visits;
+    auto result = gtp_execute("clear_cache");
+    EXPECT_EQ(result.first.find("? "), 0u);
+    result = gtp_execute("lz-setoption name visits value 5");
+    EXPECT_EQ(result.first.find("? "), 0u);
+    EXPECT_EQ(cfg_max_visits, visits);
+    cfg_server_port = 0;
+
+    result = gtp_execute("clear_cache");
+    EXPECT_EQ(result.first.find("= "), 0u);
+}
+
 // Basic TimeControl test
 TEST_F(LeelaTest, TimeControl) {
     std::pair<std::string, std::string> result;
@@ -384,3 +1202,16 @@ TEST_F(LeelaTest, AnalyzeParseMinmoves) {
     // Expect to see at least 5 move priors
     expect_regex(result.first, "info.*?(prior\\s+\\d+\\s+.*?){5,}.*");
 }
+
+TEST_F(LeelaTest, AnalyzeJson) {
+    gtp_execute("clear_board");
+    gtp_execute("lz-setoption name pondering value false");
+    gtp_execute("lz-setoption name playouts value 1");
+    auto result = gtp_execute("lz-analyze b interval 1 format json deltas policy minmoves 2");
+    expect_regex(result.first,
+                 "\\{\"delta\":false,\"moves\":\\[\\{\"move\":\"[A-T]\\d+\","
+                 "\"visits\":\\d+,\"winrate\":[0-9.]+,\"prior\":[0-9.]+,"
+                 "\"lcb\":[0-9.]+,\"order\":0,\"pv\":\\[\"[A-T]\\d+\"");
+    // one prior per point, then pass
+    expect_regex(result.first, "\"policy\":\\[([0-9.]+,){361}[0-9.]+\\]\\}");
+}
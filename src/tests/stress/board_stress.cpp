@@ -0,0 +1,503 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017-2019 Gian-Carlo Pascutto and contributors
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+
+    Additional permission under GNU GPL version 3 section 7
+
+    If you modify this Program, or any covered work, by linking or
+    combining it with NVIDIA Corporation's libraries from the
+    NVIDIA CUDA Toolkit and/or the NVIDIA CUDA Deep Neural
+    Network library and/or the NVIDIA TensorRT inference library
+    (or a modified version of those libraries), containing parts covered
+    by the terms of the respective license agreement, the licensors of
+    this Program grant you additional permission to convey the resulting
+    work.
+*/
+
+/*
+    Differential stress test for the board code. Plays random legal
+    games through GameState::play_move and checks the incrementally
+    maintained state (hashes, strings, liberties, prisoners, ko and
+    score) against a slow, straightforward reference board after
+    every move.
+
+    Usage: board_stress [--games=N] [--threads=N] [--seed=N]
+*/
+
+#include <gtest/gtest.h>
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FastBoard.h"
+#include "FastState.h"
+#include "GTP.h"
+#include "GameState.h"
+#include "Random.h"
+#include "Utils.h"
+#include "Zobrist.h"
+
+namespace {
+
+struct StressOptions {
+    int games = 200;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::uint64_t seed = 5489;
+};
+
+StressOptions options;
+
+/*
+    Board that recomputes everything from scratch with flood fills.
+    Points are indexed as x + y * size, the ko point is -1 if none.
+*/
+class ReferenceBoard {
+public:
+    explicit ReferenceBoard(const FastState& state)
+        : m_size(state.board.get_boardsize()),
+          m_state(m_size * m_size),
+          m_group(m_size * m_size),
+          m_komi(state.get_komi() + state.get_handicap()) {
+        for (auto y = 0; y < m_size; y++) {
+            for (auto x = 0; x < m_size; x++) {
+                m_state[x + y * m_size] = state.board.get_state(x, y);
+            }
+        }
+        m_prisoners[FastBoard::BLACK] =
+            state.board.get_prisoners(FastBoard::BLACK);
+        m_prisoners[FastBoard::WHITE] =
+            state.board.get_prisoners(FastBoard::WHITE);
+        m_tomove = state.get_to_move();
+        m_ko = state.m_komove == FastBoard::NO_VERTEX ? -1 :
+            to_point(state.board.get_xy(state.m_komove));
+        label();
+    }
+
+    int size() const { return m_size; }
+    int to_move() const { return m_tomove; }
+    int ko() const { return m_ko; }
+    int prisoners(int color) const { return m_prisoners[color]; }
+    int state(int p) const { return m_state[p]; }
+    int group(int p) const { return m_group[p]; }
+    int group_count() const { return static_cast<int>(m_libs.size()); }
+    int group_stones(int g) const { return m_stones[g]; }
+    int group_libs(int g) const { return m_libs[g]; }
+
+    int to_point(std::pair<int, int> xy) const {
+        return xy.first + xy.second * m_size;
+    }
+
+    std::vector<int> neighbours(int p) const {
+        auto result = std::vector<int>{};
+        const auto x = p % m_size;
+        const auto y = p / m_size;
+        if (x > 0) result.push_back(p - 1);
+        if (x < m_size - 1) result.push_back(p + 1);
+        if (y > 0) result.push_back(p - m_size);
+        if (y < m_size - 1) result.push_back(p + m_size);
+        return result;
+    }
+
+    bool is_legal(int color, int p) const {
+        if (m_state[p] != FastBoard::EMPTY || p == m_ko) {
+            return false;
+        }
+        for (const auto n : neighbours(p)) {
+            if (m_state[n] == FastBoard::EMPTY) {
+                return true;
+            }
+            const auto libs = m_libs[m_group[n]];
+            if (m_state[n] == color && libs > 1) {
+                return true;
+            }
+            if (m_state[n] != color && libs == 1) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void play(int color, int p) {
+        m_tomove = !color;
+        m_ko = -1;
+        if (p < 0) {
+            return;
+        }
+
+        auto eyeplay = true;
+        for (const auto n : neighbours(p)) {
+            if (m_state[n] != !color) {
+                eyeplay = false;
+            }
+        }
+
+        m_state[p] = FastBoard::vertex_t(color);
+        auto captured = 0;
+        auto captured_point = -1;
+        for (const auto n : neighbours(p)) {
+            if (m_state[n] == !color && m_libs[m_group[n]] == 1) {
+                const auto dead = m_group[n];
+                for (auto q = 0; q < m_size * m_size; q++) {
+                    if (m_state[q] != FastBoard::EMPTY
+                        && m_group[q] == dead) {
+                        m_state[q] = FastBoard::EMPTY;
+                        captured++;
+                        captured_point = q;
+                    }
+                }
+            }
+        }
+        m_prisoners[color] += captured;
+        label();
+
+        if (captured == 1 && eyeplay) {
+            m_ko = captured_point;
+        }
+    }
+
+    float score() const {
+#ifdef ANCIENT_CHINESE_RULE_ENABLED
+        return reach(FastBoard::BLACK) - reach(FastBoard::WHITE) + m_komi;
+#else
+        return reach(FastBoard::BLACK) - reach(FastBoard::WHITE) - m_komi;
+#endif
+    }
+
+private:
+    /*
+        assign every string an index and count its stones and liberties
+    */
+    void label() {
+        m_stones.clear();
+        m_libs.clear();
+        std::fill(begin(m_group), end(m_group), -1);
+        for (auto p = 0; p < m_size * m_size; p++) {
+            if (m_state[p] == FastBoard::EMPTY || m_group[p] != -1) {
+                continue;
+            }
+            const auto g = group_count();
+            auto stones = std::vector<int>{p};
+            auto libs = std::vector<bool>(m_size * m_size, false);
+            m_group[p] = g;
+            for (size_t i = 0; i < stones.size(); i++) {
+                for (const auto n : neighbours(stones[i])) {
+                    if (m_state[n] == FastBoard::EMPTY) {
+                        libs[n] = true;
+                    } else if (m_state[n] == m_state[p]
+                               && m_group[n] == -1) {
+                        m_group[n] = g;
+                        stones.push_back(n);
+                    }
+                }
+            }
+            m_stones.push_back(stones.size());
+            m_libs.push_back(std::count(begin(libs), end(libs), true));
+        }
+    }
+
+    int reach(int color) const {
+        auto seen = std::vector<bool>(m_size * m_size, false);
+        auto reachable = 0;
+#ifdef ANCIENT_CHINESE_RULE_ENABLED
+        // every region of stones and empty points scores its size minus 2
+        for (auto p = 0; p < m_size * m_size; p++) {
+            if (m_state[p] != color || seen[p]) {
+                continue;
+            }
+            auto region = std::vector<int>{p};
+            seen[p] = true;
+            for (size_t i = 0; i < region.size(); i++) {
+                for (const auto n : neighbours(region[i])) {
+                    if (!seen[n] && (m_state[n] == color
+                                     || m_state[n] == FastBoard::EMPTY)) {
+                        seen[n] = true;
+                        region.push_back(n);
+                    }
+                }
+            }
+            reachable += region.size() - 2;
+        }
+#else
+        // stones plus empty points connected to them
+        auto region = std::vector<int>{};
+        for (auto p = 0; p < m_size * m_size; p++) {
+            if (m_state[p] == color) {
+                seen[p] = true;
+                region.push_back(p);
+            }
+        }
+        for (size_t i = 0; i < region.size(); i++) {
+            for (const auto n : neighbours(region[i])) {
+                if (!seen[n] && m_state[n] == FastBoard::EMPTY) {
+                    seen[n] = true;
+                    region.push_back(n);
+                }
+            }
+        }
+        reachable = region.size();
+#endif
+        return reachable;
+    }
+
+    int m_size;
+    std::vector<FastBoard::vertex_t> m_state;
+    std::vector<int> m_group;
+    std::vector<int> m_stones;
+    std::vector<int> m_libs;
+    std::array<int, 2> m_prisoners;
+    int m_tomove;
+    int m_ko;
+    float m_komi;
+};
+
+/*
+    compare the engine state with the reference,
+    returns a description of the first mismatch or an empty string
+*/
+std::string compare(const GameState& state, const ReferenceBoard& ref) {
+    auto out = std::ostringstream{};
+    const auto& board = state.board;
+
+    if (state.get_to_move() != ref.to_move()) {
+        out << "side to move " << state.get_to_move();
+        return out.str();
+    }
+    for (auto color : {FastBoard::BLACK, FastBoard::WHITE}) {
+        if (board.get_prisoners(color) != ref.prisoners(color)) {
+            out << "prisoners of " << color << ": "
+                << board.get_prisoners(color) << " expected "
+                << ref.prisoners(color);
+            return out.str();
+        }
+    }
+    const auto ko = state.m_komove == FastBoard::NO_VERTEX ? -1 :
+        ref.to_point(board.get_xy(state.m_komove));
+    if (ko != ref.ko()) {
+        out << "ko " << board.move_to_text(state.m_komove);
+        return out.str();
+    }
+
+    auto checked = std::vector<bool>(ref.group_count(), false);
+    for (auto y = 0; y < ref.size(); y++) {
+        for (auto x = 0; x < ref.size(); x++) {
+            const auto p = x + y * ref.size();
+            const auto vertex = board.get_vertex(x, y);
+            const auto text = board.move_to_text(vertex);
+            if (board.get_state(vertex) != ref.state(p)) {
+                out << "contents of " << text;
+                return out.str();
+            }
+            if (ref.state(p) == FastBoard::EMPTY) {
+                const auto color = ref.to_move();
+                if (state.is_move_legal(color, vertex)
+                    != ref.is_legal(color, p)) {
+                    out << "legality of " << text;
+                    return out.str();
+                }
+                continue;
+            }
+            const auto g = ref.group(p);
+            if (board.get_liberties(vertex) != ref.group_libs(g)) {
+                out << "liberties of " << text << ": "
+                    << board.get_liberties(vertex) << " expected "
+                    << ref.group_libs(g);
+                return out.str();
+            }
+            if (!checked[g]) {
+                checked[g] = true;
+                auto stones = std::istringstream{board.get_string(vertex)};
+                auto count = 0;
+                for (auto stone = std::string{}; stones >> stone; count++) {
+                    const auto sv = board.text_to_move(stone);
+                    if (ref.group(ref.to_point(board.get_xy(sv))) != g) {
+                        out << "string of " << text << " has " << stone;
+                        return out.str();
+                    }
+                }
+                if (count != ref.group_stones(g)) {
+                    out << "string of " << text << " has " << count
+                        << " stones, expected " << ref.group_stones(g);
+                    return out.str();
+                }
+            }
+        }
+    }
+
+    const auto hash = board.calc_hash(state.m_komove)
+        ^ Zobrist::zobrist_pass[0]
+        ^ Zobrist::zobrist_pass[state.get_passes()];
+    if (board.get_hash() != hash) {
+        return "hash differs from calc_hash";
+    }
+    if (board.get_ko_hash() != board.calc_ko_hash()) {
+        return "ko hash differs from calc_ko_hash";
+    }
+    for (auto s = 0; s < Zobrist::NUM_SYMMETRIES; s++) {
+        if (state.get_symmetry_hash(s)
+            != board.calc_symmetry_hash(state.m_komove, s)) {
+            out << "symmetry hash " << s;
+            return out.str();
+        }
+    }
+    if (state.final_score() != ref.score()) {
+        out << "score " << state.final_score() << " expected "
+            << ref.score();
+        return out.str();
+    }
+    return {};
+}
+
+/*
+    play and take back the move on a copy, which has to give
+    back the exact same position
+*/
+std::string check_undo(const GameState& state, int vertex) {
+    auto scratch = FastState{state};
+    auto undo = FastState::MoveUndo{};
+    scratch.play_move(vertex, undo);
+    scratch.unplay_move(undo);
+    if (scratch.board.get_hash() != state.board.get_hash()
+        || scratch.board.get_ko_hash() != state.board.get_ko_hash()
+        || scratch.board.calc_hash(scratch.m_komove)
+            != state.board.calc_hash(state.m_komove)
+        || scratch.get_movenum() != state.get_movenum()) {
+        return "unplay_move did not restore the position";
+    }
+    return {};
+}
+
+std::string play_game(std::uint64_t seed) {
+    Random rng(seed);
+    GameState state;
+    state.init_game(BOARD_SIZE, KOMI);
+    auto ref = ReferenceBoard{state};
+
+    const auto max_moves = 3 * BOARD_SIZE * BOARD_SIZE;
+    auto moves = std::vector<int>{};
+    while (state.get_passes() < 2
+           && static_cast<int>(state.get_movenum()) < max_moves) {
+        const auto color = state.get_to_move();
+        moves.clear();
+        for (auto y = 0; y < BOARD_SIZE; y++) {
+            for (auto x = 0; x < BOARD_SIZE; x++) {
+                const auto vertex = state.board.get_vertex(x, y);
+                if (state.is_move_legal(color, vertex)
+                    && !state.board.is_eye(color, vertex)) {
+                    moves.push_back(vertex);
+                }
+            }
+        }
+        auto vertex = int{FastBoard::PASS};
+        if (!moves.empty() && rng.randfix<100>() != 0) {
+            vertex = moves[rng.randuint64(moves.size())];
+        }
+
+        auto error = std::string{};
+        if (rng.randfix<8>() == 0) {
+            error = check_undo(state, vertex);
+        }
+        if (error.empty()) {
+            state.play_move(vertex);
+            ref.play(color, vertex == FastBoard::PASS ? -1 :
+                     ref.to_point(state.board.get_xy(vertex)));
+            error = compare(state, ref);
+        }
+        if (!error.empty()) {
+            auto out = std::ostringstream{};
+            out << "seed " << seed << ", move " << state.get_movenum()
+                << " (" << state.move_to_text(vertex) << "): " << error;
+            return out.str();
+        }
+    }
+    return {};
+}
+
+}
+
+TEST(BoardStress, RandomGames) {
+    std::atomic<int> next_game{0};
+    std::vector<std::string> failures;
+    std::mutex failures_mutex;
+
+    auto worker = [&]() {
+        for (auto game = next_game++; game < options.games;
+             game = next_game++) {
+            auto error = play_game(options.seed + game);
+            if (!error.empty()) {
+                std::lock_guard<std::mutex> lock(failures_mutex);
+                failures.emplace_back(std::move(error));
+            }
+        }
+    };
+
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 0; i < options.threads; i++) {
+        threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const auto& failure : failures) {
+        ADD_FAILURE() << failure;
+    }
+    EXPECT_TRUE(failures.empty());
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+
+    for (auto i = 1; i < argc; i++) {
+        const auto arg = std::string{argv[i]};
+        const auto value = arg.substr(arg.find('=') + 1);
+        if (arg.find("--games=") == 0) {
+            options.games = std::stoi(value);
+        } else if (arg.find("--threads=") == 0) {
+            options.threads = std::max(1, std::stoi(value));
+        } else if (arg.find("--seed=") == 0) {
+            options.seed = std::stoull(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            std::cerr << "Usage: " << argv[0]
+                      << " [--games=N] [--threads=N] [--seed=N]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    GTP::setup_default_parameters();
+    cfg_quiet = true;
+
+    // Use deterministic random numbers for hashing
+    auto rng = std::make_unique<Random>(5489);
+    Zobrist::init_zobrist(*rng);
+
+    std::cout << "Playing " << options.games << " games on "
+              << options.threads << " threads, seed "
+              << options.seed << std::endl;
+
+    return RUN_ALL_TESTS();
+}
@@ -87,9 +87,14 @@ class ChunkParser:
             no record seperator. The most compact format.
             Data in the shuffle buffer is held in this
             format as it allows the largest possible shuffle buffer.
-            Very fast to decode. Preferred format to use on disk.
+            Very fast to decode.
             2176 bytes long.
 
+            v3: v2 with the probabilities stored as float16, as written
+            by leelaz --binary-training. Preferred format to use on disk.
+            Converted to v2 when read.
+            1452 bytes long.
+
             raw: A byte string holding raw tensors contenated together.
             This is used to pass data from the workers to the parent.
             Exists because TensorFlow doesn't have a fast way to
@@ -149,6 +154,14 @@ class ChunkParser:
         # uint8 is_winner (1 byte)
         self.v2_struct = struct.Struct('4s1448s722sBB')
 
+        # V3 Format
+        # int32 version (4 bytes)
+        # (19*19+1) float16 probabilities (724 bytes)
+        # 19*19*16 packed bit planes (722 bytes)
+        # uint8 side_to_move (1 byte)
+        # uint8 is_winner (1 byte)
+        self.v3_struct = struct.Struct('4s724s722sBB')
+
         # Struct used to return data from child workers.
         # float32 winner
         # float32*392 probs
@@ -221,6 +234,17 @@ class ChunkParser:
 
         return True, self.v2_struct.pack(version, probs, planes, stm, winner)
 
+    def convert_v3_to_v2(self, content):
+        """
+            Convert v3 packed binary format to v2 by widening
+            the probabilities to float32.
+        """
+        (ver, probs, planes, stm, winner) = self.v3_struct.unpack(content)
+        probs = np.frombuffer(probs, dtype='<f2').astype(np.float32)
+        version = struct.pack('i', 1)
+        return self.v2_struct.pack(version, probs.tobytes(), planes, stm,
+                                   winner)
+
     def v2_apply_symmetry(self, symmetry, content):
         """
             Apply a random symmetry to a v2 record.
@@ -294,6 +318,15 @@ class ChunkParser:
                     if random.randint(0, self.sample-1) != 0:
                         continue  # Skip this record.
                 yield chunkdata[i:i+self.v2_struct.size]
+        elif chunkdata[0:4] == b'\3\0\0\0':
+            #print("V3 chunkdata")
+            for i in range(0, len(chunkdata), self.v3_struct.size):
+                if self.sample > 1:
+                    # Downsample, using only 1/Nth of the items.
+                    if random.randint(0, self.sample-1) != 0:
+                        continue  # Skip this record.
+                yield self.convert_v3_to_v2(
+                    chunkdata[i:i+self.v3_struct.size])
         else:
             #print("V1 chunkdata")
             file_chunkdata = chunkdata.splitlines()